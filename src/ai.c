@@ -0,0 +1,295 @@
+/*
+ * ai.c - part of Tessalatrix
+ *
+ * The autoplayer; plays the standard game all by itself, for attract mode
+ * and for long unattended soak runs. It drives the game engine through the
+ * same inputs a person would, so it plays by exactly the same rules, and
+ * simply starts another game whenever one ends.
+ *
+ * Copyright (c) 2023 Pete Favelle <ahnlak@ahnlak.com>
+ *
+ * This file is released under the MIT License; see LICENSE for details.
+ */
+
+/* System headers. */
+
+#include <stdio.h>
+#include "SDL.h"
+
+
+/* Local headers. */
+
+#include "tessalatrix.h"
+
+
+/* Module variables. */
+
+static trix_weights_st    m_weights;
+static trix_search_st     m_search;
+static trix_rollout_st    m_rollout;
+static uint_fast8_t       m_preview;
+static uint_fast16_t      m_rollouts;
+static trix_placement_st  m_target;
+static uint_fast32_t      m_target_piece;
+static bool               m_thinking;
+static uint_fast32_t      m_games_played;
+static bool               m_user_interrupt;
+
+
+/*
+ * Static functions; a collection of things only built for use locally.
+ */
+
+/*
+ * choose_target - picks the placement we'll steer the current piece towards;
+ *                 by a beam search through the upcoming pieces with a
+ *                 preview, and otherwise just the best for this piece alone.
+ *                 If rollouts have been asked for, they can only improve on
+ *                 this once they arrive. This is timed, to keep an eye on how
+ *                 much of a frame it takes.
+ */
+
+static void ai_choose_target( void )
+{
+  uint64_t  l_start = SDL_GetPerformanceCounter();
+  bool      l_found;
+
+  /* Remember which piece this target is for, even if there isn't one. */
+  m_target_piece = core_state( game_core() )->pieces;
+  if ( m_preview > 0 )
+  {
+    l_found = search_choose( &m_search, game_core(), &m_weights, m_preview, &m_target );
+  }
+  else
+  {
+    l_found = eval_choose( game_core(), &m_weights, &m_target );
+  }
+  if ( !l_found )
+  {
+    m_target.path_length = 0;
+    m_target.location = core_state( game_core() )->location;
+    m_target.rotation = core_state( game_core() )->rotation;
+  }
+
+  log_write( TRACE, "Autoplayer chose a placement in %.3fms",
+             ( SDL_GetPerformanceCounter() - l_start ) * 1000.0 / SDL_GetPerformanceFrequency() );
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * think - lends the rollout pool a hand for a few milliseconds at most, so
+ *         as never to hold up a frame, and not at all once there's nothing
+ *         left but to wait for the pool; once the rollouts are all done, their
+ *         choice becomes the target, as long as it's still for this piece and
+ *         it can still be reached.
+ */
+
+static void ai_think( void )
+{
+  uint64_t            l_start = SDL_GetPerformanceCounter();
+  uint64_t            l_budget = SDL_GetPerformanceFrequency() * TRIX_AI_THINK_US / 1000000;
+  trix_placement_st   l_choice;
+  trix_rollout_poll_t l_poll;
+
+  /* Keep going until there's an answer, or we're out of time or work. */
+  while ( ( l_poll = rollout_poll( &m_rollout, TRIX_AI_ROLLOUT_BATCH, &l_choice ) ) != ROLLOUT_DONE )
+  {
+    if ( ( l_poll == ROLLOUT_WAITING ) ||
+         ( SDL_GetPerformanceCounter() - l_start >= l_budget ) )
+    {
+      return;
+    }
+  }
+  m_thinking = false;
+
+  /* The piece may have moved on too far in the meantime. */
+  if ( ( core_state( game_core() )->pieces == m_target_piece ) &&
+       ( moves_next_input( game_core(), &l_choice ) != INPUT_MAX ) )
+  {
+    m_target = l_choice;
+    log_write( TRACE, "Autoplayer rollouts chose a placement" );
+  }
+
+  /* All done. */
+  return;
+}
+
+
+/* Functions. */
+
+/*
+ * init - called when the engine is activated, to do any one-time initialising.
+ */
+
+void ai_init( void )
+{
+  /* The autoplayer runs on top of a perfectly ordinary game. */
+  game_init();
+  game_autoplay( true );
+
+  /* Set up our evaluation and search. */
+  eval_default_weights( &m_weights );
+  search_init( &m_search );
+  m_preview = 0;
+  if ( config_get_int( CONF_AI_PREVIEW ) > 0 )
+  {
+    m_preview = config_get_int( CONF_AI_PREVIEW ) > TRIX_SEARCH_DEPTH_MAX ?
+                TRIX_SEARCH_DEPTH_MAX : config_get_int( CONF_AI_PREVIEW );
+  }
+
+  /* Rollouts need their thread pool started. */
+  m_rollouts = 0;
+  if ( config_get_int( CONF_AI_ROLLOUTS ) > 0 )
+  {
+    m_rollouts = config_get_int( CONF_AI_ROLLOUTS ) > TRIX_ROLLOUT_MAX ?
+                 TRIX_ROLLOUT_MAX : config_get_int( CONF_AI_ROLLOUTS );
+    if ( !rollout_init( &m_rollout, 0 ) )
+    {
+      log_write( ERROR, "Failed to start the rollout thread pool" );
+      m_rollouts = 0;
+    }
+    else
+    {
+      log_write( LOG, "Autoplayer using %u rollouts per move, across %u threads",
+                 (unsigned int)m_rollouts, (unsigned int)m_rollout.threads );
+    }
+  }
+
+  /* And make sure we choose a fresh target. */
+  m_target_piece = 0;
+  m_thinking = false;
+  m_games_played = 0;
+
+  /* Nobody has asked us to stop, yet. */
+  m_user_interrupt = false;
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * event - called for every SDL event received; it's up to the engine what
+ *         to do with them, but effects should be queued and handled within
+ *         the update.
+ */
+
+void ai_event( const SDL_Event *p_event )
+{
+  /* The game underneath needs to hear about anything that affects how it */
+  /* draws, such as the renderer losing its targets.                      */
+  game_event( p_event );
+
+  /* Any key or click means someone wants to play for real. */
+  if ( ( p_event->type == SDL_KEYDOWN ) || ( p_event->type == SDL_MOUSEBUTTONDOWN ) )
+  {
+    m_user_interrupt = true;
+  }
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * update - update the internal state of the engine; this is where the
+ *          autoplayer decides on its next input, and feeds it to the game.
+ */
+
+trix_engine_t ai_update( void )
+{
+  const trix_gamestate_st  *l_state = core_state( game_core() );
+  trix_input_t              l_input;
+
+  /* If we've been interrupted, head back to the menu. */
+  if ( m_user_interrupt )
+  {
+    return ENGINE_MENU;
+  }
+
+  /* Every new piece needs a new target; something quick to be going on */
+  /* with, and rollouts to improve on it if we're using them.           */
+  if ( ( l_state->piece != NULL ) && ( l_state->pieces != m_target_piece ) )
+  {
+    ai_choose_target();
+    if ( m_rollouts > 0 )
+    {
+      m_thinking = rollout_start( &m_rollout, game_core(), &m_weights, m_rollouts,
+                                  TRIX_AI_ROLLOUT_HORIZON );
+    }
+  }
+
+  /* See how the rollouts are getting on. */
+  if ( m_thinking )
+  {
+    ai_think();
+  }
+
+  /* Work out how to get there; if we can't any more, think again. */
+  l_input = moves_next_input( game_core(), &m_target );
+  if ( l_input == INPUT_MAX )
+  {
+    ai_choose_target();
+    l_input = moves_next_input( game_core(), &m_target );
+    if ( l_input == INPUT_MAX )
+    {
+      l_input = INPUT_DROP;
+    }
+  }
+
+  /* And feed that into the game, just as a player would. */
+  if ( !game_step( l_input ) )
+  {
+    /* Game over; note how we did, and go again. */
+    m_games_played++;
+    log_write( LOG, "Autoplayer game %u over; score %u, lines %u, pieces %u",
+               (unsigned int)m_games_played, (unsigned int)l_state->score,
+               (unsigned int)l_state->lines, (unsigned int)l_state->pieces );
+    game_restart();
+    m_target_piece = 0;
+  }
+
+  /* We steer a step at a time, so want another look next frame. */
+  sched_at( TIMER_ANIMATION, SDL_GetTicks() + TRIX_FPS_MS );
+
+  /* By default, ask to stay in our current engine. */
+  return ENGINE_AI;
+}
+
+
+/*
+ * render - draws the internal state of the engine onto the screen; this is
+ *          just the game itself.
+ */
+
+void ai_render( void )
+{
+  game_render();
+  return;
+}
+
+
+/*
+ * fini - called when the engine is being stopped, to do any tear down.
+ */
+
+void ai_fini( void )
+{
+  /* Stop any rollout threads. */
+  if ( m_rollouts > 0 )
+  {
+    rollout_fini( &m_rollout );
+  }
+
+  /* And the game underneath. */
+  game_fini();
+
+  /* All done. */
+  return;
+}
+
+
+/* End of file ai.c */
@@ -0,0 +1,727 @@
+/*
+ * asset.c - part of Tessalatrix
+ *
+ * Keeps hold of the textures loaded from our assets, so that engines coming
+ * and going don't have to decode the same images over and over again. Each
+ * texture is counted out and back in; once nobody is using it, it stays where
+ * it is until we need the room - either for another texture, or because the
+ * textures we're holding have grown beyond the configured budget.
+ *
+ * Images can also be asked for ahead of time; a small pool of worker threads
+ * decodes them into surfaces in the background, so that all that's left to
+ * do on the main thread when they're needed is to upload them as textures.
+ * If no workers can be started, the decoding is simply done when the image
+ * is first needed.
+ *
+ * The asset directory is only looked at once, at startup; every file found
+ * there is kept in an index by asset name and scale, so that finding the
+ * right file for an asset never has to go anywhere near the filesystem.
+ * Files are named <asset-name>-<scale-factor>.png, or just <asset-name>.png
+ * for those only drawn at the lowest resolution.
+ *
+ * Copyright (c) 2023 Pete Favelle <ahnlak@ahnlak.com>
+ *
+ * This file is released under the MIT License; see LICENSE for details.
+ */
+
+/* System headers. */
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "SDL.h"
+#include "SDL_image.h"
+
+
+/* Local headers. */
+
+#include "tessalatrix.h"
+
+
+/* Module variables. */
+
+static trix_asset_st  m_assets[TRIX_ASSET_CACHE_SIZE];
+static uint_fast32_t  m_asset_clock;
+static uint_fast32_t  m_asset_bytes;
+static uint_fast32_t  m_asset_budget;
+
+static trix_asset_file_st m_index[TRIX_ASSET_INDEX_SIZE];
+static uint_fast8_t   m_index_count;
+
+static SDL_mutex     *m_lock;
+static SDL_cond      *m_wake;
+static SDL_cond      *m_done;
+static SDL_Thread    *m_workers[TRIX_ASSET_WORKERS];
+static uint_fast8_t   m_worker_count;
+static bool           m_stopping;
+
+
+/*
+ * Static functions; a collection of things only built for use locally.
+ */
+
+/*
+ * hash - works out where in the index an asset name and scale should go.
+ */
+
+static uint_fast32_t asset_hash( const char *p_asset_name, uint_fast8_t p_scale )
+{
+  uint32_t  l_hash = 2166136261u;
+
+  /* FNV-1a, over the name and then the scale. */
+  while ( *p_asset_name != '\0' )
+  {
+    l_hash = ( l_hash ^ (uint8_t)*p_asset_name++ ) * 16777619u;
+  }
+  l_hash = ( l_hash ^ p_scale ) * 16777619u;
+
+  return l_hash % TRIX_ASSET_INDEX_SIZE;
+}
+
+
+/*
+ * index_file - adds a single file from the asset directory to the index, if
+ *              it looks like one of ours; the scale is taken from the end of
+ *              the name, if it has one.
+ */
+
+static void asset_index_file( const char *p_filename )
+{
+  size_t        l_length = strlen( p_filename );
+  size_t        l_name_length;
+  const char   *l_suffix;
+  char          l_name[TRIX_ASSET_NAME_MAX];
+  uint_fast8_t  l_scale = 0;
+  uint_fast32_t l_slot;
+
+  /* Only PNGs are of any interest. */
+  if ( ( l_length <= 4 ) || ( strcmp( p_filename + l_length - 4, ".png" ) != 0 ) )
+  {
+    return;
+  }
+  l_name_length = l_length - 4;
+
+  /* A trailing dash and number is the scale, rather than part of the name. */
+  l_suffix = p_filename + l_name_length;
+  while ( ( l_suffix > p_filename ) && ( l_suffix[-1] >= '0' ) && ( l_suffix[-1] <= '9' ) )
+  {
+    l_suffix--;
+  }
+  if ( ( l_suffix < p_filename + l_name_length ) && ( l_suffix > p_filename + 1 ) &&
+       ( l_suffix[-1] == '-' ) && ( atoi( l_suffix ) > 0 ) && ( atoi( l_suffix ) <= UINT8_MAX ) )
+  {
+    l_scale = atoi( l_suffix );
+    l_name_length = l_suffix - 1 - p_filename;
+  }
+
+  /* Make sure it's going to fit. */
+  if ( ( l_name_length >= TRIX_ASSET_NAME_MAX ) ||
+       ( strlen( TRIX_ASSET_PATH ) + 1 + l_length >= TRIX_ASSET_FILE_MAX ) )
+  {
+    log_write( WARN, "Ignoring asset file %s, the name is too long", p_filename );
+    return;
+  }
+  if ( m_index_count >= TRIX_ASSET_INDEX_SIZE * 3 / 4 )
+  {
+    log_write( WARN, "Ignoring asset file %s, the index is full", p_filename );
+    return;
+  }
+  memcpy( l_name, p_filename, l_name_length );
+  l_name[l_name_length] = '\0';
+
+  /* Find its place in the index, stepping on past anything in the way. */
+  for ( l_slot = asset_hash( l_name, l_scale ); m_index[l_slot].name[0] != '\0';
+        l_slot = ( l_slot + 1 ) % TRIX_ASSET_INDEX_SIZE )
+  {
+    if ( ( m_index[l_slot].scale == l_scale ) && ( strcmp( m_index[l_slot].name, l_name ) == 0 ) )
+    {
+      return;
+    }
+  }
+
+  /* And file it away. */
+  memcpy( m_index[l_slot].name, l_name, l_name_length + 1 );
+  m_index[l_slot].scale = l_scale;
+  snprintf( m_index[l_slot].filename, TRIX_ASSET_FILE_MAX, "%s/%s", TRIX_ASSET_PATH, p_filename );
+  m_index_count++;
+
+  log_write( TRACE, "Indexed %s at scale %d as %s", l_name, l_scale, m_index[l_slot].filename );
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * index - builds the index from everything in the asset directory.
+ */
+
+static void asset_index( void )
+{
+  DIR           *l_dir;
+  struct dirent *l_entry;
+
+  memset( m_index, 0, sizeof( m_index ) );
+  m_index_count = 0;
+
+  /* Without a directory, there's nothing to draw with; but carry on. */
+  l_dir = opendir( TRIX_ASSET_PATH );
+  if ( l_dir == NULL )
+  {
+    log_write( ERROR, "Unable to read asset directory %s", TRIX_ASSET_PATH );
+    return;
+  }
+  while ( ( l_entry = readdir( l_dir ) ) != NULL )
+  {
+    asset_index_file( l_entry->d_name );
+  }
+  closedir( l_dir );
+
+  log_write( LOG, "Indexed %d asset files", (int)m_index_count );
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * lock, unlock - guard the entries against the workers; entries are only
+ *                ever filled or emptied by the main thread, but the workers
+ *                decode into them.
+ */
+
+static void asset_lock( void )
+{
+  if ( m_lock != NULL )
+  {
+    SDL_LockMutex( m_lock );
+  }
+  return;
+}
+
+static void asset_unlock( void )
+{
+  if ( m_lock != NULL )
+  {
+    SDL_UnlockMutex( m_lock );
+  }
+  return;
+}
+
+
+/*
+ * decode - decodes the image for an entry into a surface; the entry must
+ *          already have been claimed for decoding, so nothing else will touch
+ *          it. Called without the lock held, as this is the slow bit, and
+ *          often from a worker; so any failure is only noted in the entry,
+ *          for the main thread to log when it comes to acquire it.
+ */
+
+static void asset_decode( trix_asset_st *p_asset )
+{
+  SDL_Surface  *l_surface;
+
+  l_surface = IMG_Load( p_asset->filename );
+
+  asset_lock();
+  if ( l_surface == NULL )
+  {
+    snprintf( p_asset->error, sizeof( p_asset->error ), "IMG_Load of %s failed - %s",
+              p_asset->name, SDL_GetError() );
+    p_asset->state = ASSET_FAILED;
+  }
+  else
+  {
+    p_asset->surface = l_surface;
+    p_asset->state = ASSET_DECODED;
+  }
+
+  /* Anyone waiting on this will want to know it's done. */
+  if ( m_done != NULL )
+  {
+    SDL_CondBroadcast( m_done );
+  }
+  asset_unlock();
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * worker - the body of each decoding thread; it sleeps until there's an
+ *          image waiting to be decoded, and decodes it.
+ */
+
+static int asset_worker( void *p_arg )
+{
+  uint_fast8_t   l_index;
+  trix_asset_st *l_asset;
+
+  SDL_LockMutex( m_lock );
+  while ( !m_stopping )
+  {
+    /* Find the first thing waiting to be decoded, if anything. */
+    for ( l_asset = NULL, l_index = 0; l_index < TRIX_ASSET_CACHE_SIZE; l_index++ )
+    {
+      if ( m_assets[l_index].state == ASSET_QUEUED )
+      {
+        l_asset = &m_assets[l_index];
+        break;
+      }
+    }
+
+    /* Nothing to do, so sleep until there is. */
+    if ( l_asset == NULL )
+    {
+      SDL_CondWait( m_wake, m_lock );
+      continue;
+    }
+
+    /* Claim it, and decode it without holding everyone else up. */
+    l_asset->state = ASSET_DECODING;
+    SDL_UnlockMutex( m_lock );
+    asset_decode( l_asset );
+    SDL_LockMutex( m_lock );
+  }
+  SDL_UnlockMutex( m_lock );
+
+  /* All done. */
+  return 0;
+}
+
+
+/*
+ * find - looks for an entry for the named asset at the current scale, in
+ *        whatever state it may be. The lock must be held.
+ */
+
+static trix_asset_st *asset_find( const char *p_asset_name )
+{
+  uint_fast8_t  l_index;
+  uint_fast8_t  l_scale = display_get_scale();
+
+  for ( l_index = 0; l_index < TRIX_ASSET_CACHE_SIZE; l_index++ )
+  {
+    if ( ( m_assets[l_index].state != ASSET_EMPTY ) && ( m_assets[l_index].scale == l_scale ) &&
+         ( strcmp( m_assets[l_index].name, p_asset_name ) == 0 ) )
+    {
+      return &m_assets[l_index];
+    }
+  }
+
+  return NULL;
+}
+
+
+/*
+ * discard - throws away whatever is held in an entry, and empties it. The
+ *           lock must be held, and the entry mustn't be being decoded.
+ */
+
+static void asset_discard( trix_asset_st *p_asset )
+{
+  log_write( TRACE, "Discarding %s at scale %d", p_asset->name, p_asset->scale );
+
+  if ( p_asset->texture != NULL )
+  {
+    SDL_DestroyTexture( p_asset->texture );
+  }
+  if ( p_asset->surface != NULL )
+  {
+    SDL_FreeSurface( p_asset->surface );
+  }
+  m_asset_bytes -= p_asset->bytes;
+  memset( p_asset, 0, sizeof( trix_asset_st ) );
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * oldest - finds the least recently used entry that nobody is using, and
+ *          which isn't waiting on a worker; empty entries are older than any
+ *          other. Returns NULL if every entry is busy. The lock must be held.
+ */
+
+static trix_asset_st *asset_oldest( void )
+{
+  uint_fast8_t   l_index;
+  trix_asset_st *l_oldest = NULL;
+
+  for ( l_index = 0; l_index < TRIX_ASSET_CACHE_SIZE; l_index++ )
+  {
+    if ( ( m_assets[l_index].refcount == 0 ) &&
+         ( m_assets[l_index].state != ASSET_QUEUED ) &&
+         ( m_assets[l_index].state != ASSET_DECODING ) &&
+         ( ( l_oldest == NULL ) || ( m_assets[l_index].last_used < l_oldest->last_used ) ) )
+    {
+      l_oldest = &m_assets[l_index];
+    }
+  }
+
+  return l_oldest;
+}
+
+
+/*
+ * claim - finds an entry for the named asset, throwing away the oldest one
+ *         to make room, and works out which file it's coming from. Returns
+ *         NULL if every entry is busy. The lock must be held.
+ */
+
+static trix_asset_st *asset_claim( const char *p_asset_name )
+{
+  trix_asset_st *l_asset;
+
+  /* Find somewhere to keep it. */
+  l_asset = asset_oldest();
+  if ( l_asset == NULL )
+  {
+    log_write( WARN, "No room to keep %s, all %d entries in use", p_asset_name, TRIX_ASSET_CACHE_SIZE );
+    return NULL;
+  }
+  if ( l_asset->state != ASSET_EMPTY )
+  {
+    asset_discard( l_asset );
+  }
+
+  /* And remember what it is, and where it is. */
+  snprintf( l_asset->name, sizeof( l_asset->name ), "%s", p_asset_name );
+  l_asset->scale = display_get_scale();
+  l_asset->asset_scale = display_find_asset( p_asset_name, l_asset->filename );
+  l_asset->last_used = ++m_asset_clock;
+  return l_asset;
+}
+
+
+/*
+ * trim - throws away unused textures, oldest first, until we're back within
+ *        our budget (if we have one). The lock must be held.
+ */
+
+static void asset_trim( void )
+{
+  uint_fast8_t   l_index;
+  trix_asset_st *l_oldest;
+
+  while ( ( m_asset_budget > 0 ) && ( m_asset_bytes > m_asset_budget ) )
+  {
+    /* Only loaded textures count against the budget. */
+    for ( l_oldest = NULL, l_index = 0; l_index < TRIX_ASSET_CACHE_SIZE; l_index++ )
+    {
+      if ( ( m_assets[l_index].refcount == 0 ) && ( m_assets[l_index].state == ASSET_LOADED ) &&
+           ( ( l_oldest == NULL ) || ( m_assets[l_index].last_used < l_oldest->last_used ) ) )
+      {
+        l_oldest = &m_assets[l_index];
+      }
+    }
+    if ( l_oldest == NULL )
+    {
+      break;
+    }
+    asset_discard( l_oldest );
+  }
+
+  /* All done. */
+  return;
+}
+
+
+/* Functions. */
+
+/*
+ * init - indexes the asset directory, prepares an empty cache with the budget
+ *        taken from the config, and starts up the decoding workers.
+ */
+
+void asset_init( void )
+{
+  memset( m_assets, 0, sizeof( m_assets ) );
+  m_asset_clock = m_asset_bytes = 0;
+  asset_index();
+  m_asset_budget = config_get_int( CONF_ASSET_BUDGET ) * 1024;
+  m_worker_count = 0;
+  m_stopping = false;
+
+  /* Without the locking, there can't be any workers. */
+  m_lock = SDL_CreateMutex();
+  m_wake = SDL_CreateCond();
+  m_done = SDL_CreateCond();
+  if ( ( m_lock == NULL ) || ( m_wake == NULL ) || ( m_done == NULL ) )
+  {
+    log_write( WARN, "Unable to create asset locks - %s", SDL_GetError() );
+    return;
+  }
+
+  /* Start as many workers as we can; even none is fine. */
+  while ( m_worker_count < TRIX_ASSET_WORKERS )
+  {
+    m_workers[m_worker_count] = SDL_CreateThread( asset_worker, "asset", NULL );
+    if ( m_workers[m_worker_count] == NULL )
+    {
+      log_write( LOG, "Unable to start asset worker - %s", SDL_GetError() );
+      break;
+    }
+    m_worker_count++;
+  }
+  log_write( LOG, "Decoding assets across %d workers", (int)m_worker_count );
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * locate - returns the file holding the named asset at the given scale, or a
+ *          scale of 0 for the unscaled asset; NULL if there isn't one.
+ */
+
+const char *asset_locate( const char *p_asset_name, uint_fast8_t p_scale )
+{
+  uint_fast32_t l_slot;
+
+  for ( l_slot = asset_hash( p_asset_name, p_scale ); m_index[l_slot].name[0] != '\0';
+        l_slot = ( l_slot + 1 ) % TRIX_ASSET_INDEX_SIZE )
+  {
+    if ( ( m_index[l_slot].scale == p_scale ) && ( strcmp( m_index[l_slot].name, p_asset_name ) == 0 ) )
+    {
+      return m_index[l_slot].filename;
+    }
+  }
+
+  return NULL;
+}
+
+
+/*
+ * prefetch - asks for the named asset to be decoded in the background, ready
+ *            for when it's acquired; if it's already been asked for, it's
+ *            just marked as recently used.
+ */
+
+void asset_prefetch( const char *p_asset_name )
+{
+  trix_asset_st *l_asset;
+
+  asset_lock();
+
+  /* If it's already here (or on its way), there's nothing to do. */
+  l_asset = asset_find( p_asset_name );
+  if ( l_asset != NULL )
+  {
+    l_asset->last_used = ++m_asset_clock;
+    asset_unlock();
+    return;
+  }
+
+  /* Otherwise, queue it up for a worker. */
+  l_asset = asset_claim( p_asset_name );
+  if ( l_asset != NULL )
+  {
+    l_asset->state = ASSET_QUEUED;
+    if ( m_wake != NULL )
+    {
+      SDL_CondSignal( m_wake );
+    }
+  }
+
+  asset_unlock();
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * acquire - returns the texture for the named asset, at the best scale we
+ *           have for the current resolution; the scale of the image that was
+ *           loaded is placed in p_scale. Every texture acquired should be
+ *           released again with asset_release. Returns NULL on failure.
+ */
+
+SDL_Texture *asset_acquire( const char *p_asset_name, uint_fast8_t *p_scale )
+{
+  char           l_asset_filename[TRIX_PATH_MAX+1];
+  trix_asset_st *l_asset;
+  SDL_Surface   *l_surface;
+  SDL_Texture   *l_texture;
+  Uint32         l_format;
+  int            l_width, l_height;
+
+  asset_lock();
+
+  /* Find it if we already have it, or somewhere to put it if not. */
+  l_asset = asset_find( p_asset_name );
+  if ( l_asset == NULL )
+  {
+    l_asset = asset_claim( p_asset_name );
+  }
+
+  /* If there's nowhere to keep it, load it for the caller alone. */
+  if ( l_asset == NULL )
+  {
+    asset_unlock();
+    *p_scale = display_find_asset( p_asset_name, l_asset_filename );
+    return IMG_LoadTexture( display_get_renderer(), l_asset_filename );
+  }
+  *p_scale = l_asset->asset_scale;
+
+  /* If nobody has started decoding it, we'll have to do it ourselves. */
+  if ( ( l_asset->state == ASSET_EMPTY ) || ( l_asset->state == ASSET_QUEUED ) )
+  {
+    l_asset->state = ASSET_DECODING;
+    asset_unlock();
+    asset_decode( l_asset );
+    asset_lock();
+  }
+
+  /* If a worker has it, wait for them to finish. */
+  while ( l_asset->state == ASSET_DECODING )
+  {
+    SDL_CondWait( m_done, m_lock );
+  }
+
+  /* Decoded images just need uploading. */
+  if ( l_asset->state == ASSET_DECODED )
+  {
+    l_surface = l_asset->surface;
+    l_asset->surface = NULL;
+    l_asset->texture = SDL_CreateTextureFromSurface( display_get_renderer(), l_surface );
+    SDL_FreeSurface( l_surface );
+    if ( l_asset->texture == NULL )
+    {
+      snprintf( l_asset->error, sizeof( l_asset->error ), "SDL_CreateTextureFromSurface of %s failed - %s",
+                p_asset_name, SDL_GetError() );
+      l_asset->state = ASSET_FAILED;
+    }
+    else
+    {
+      /* Work out roughly how much room it's taking up. */
+      l_asset->state = ASSET_LOADED;
+      if ( SDL_QueryTexture( l_asset->texture, &l_format, NULL, &l_width, &l_height ) == 0 )
+      {
+        l_asset->bytes = l_width * l_height * SDL_BYTESPERPIXEL( l_format );
+        m_asset_bytes += l_asset->bytes;
+      }
+      log_write( TRACE, "Loaded %s at scale %d, %d bytes held", p_asset_name, l_asset->scale, (int)m_asset_bytes );
+    }
+  }
+
+  /* Failures aren't kept; we'll try again next time. */
+  if ( l_asset->state == ASSET_FAILED )
+  {
+    log_write( ERROR, "%s", l_asset->error );
+    asset_discard( l_asset );
+    asset_unlock();
+    return NULL;
+  }
+
+  /* Count it out. */
+  l_asset->refcount++;
+  l_asset->last_used = ++m_asset_clock;
+  l_texture = l_asset->texture;
+
+  /* That may have taken us over budget. */
+  asset_trim();
+  asset_unlock();
+  return l_texture;
+}
+
+
+/*
+ * release - hands back a texture obtained from asset_acquire; it's kept for
+ *           next time, unless we're short of room.
+ */
+
+void asset_release( SDL_Texture *p_texture )
+{
+  uint_fast8_t  l_index;
+
+  /* Nothing acquired, nothing to release. */
+  if ( p_texture == NULL )
+  {
+    return;
+  }
+
+  /* Find it, and count it back in. */
+  asset_lock();
+  for ( l_index = 0; l_index < TRIX_ASSET_CACHE_SIZE; l_index++ )
+  {
+    if ( m_assets[l_index].texture == p_texture )
+    {
+      if ( m_assets[l_index].refcount > 0 )
+      {
+        m_assets[l_index].refcount--;
+      }
+      asset_trim();
+      asset_unlock();
+      return;
+    }
+  }
+  asset_unlock();
+
+  /* It was never kept, so it can go straight away. */
+  SDL_DestroyTexture( p_texture );
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * fini - stops the workers, and throws away everything we're holding; any
+ *        textures still acquired become invalid.
+ */
+
+void asset_fini( void )
+{
+  uint_fast8_t  l_index;
+
+  /* Wake up the workers, and wait for them to finish what they're doing. */
+  asset_lock();
+  m_stopping = true;
+  if ( m_wake != NULL )
+  {
+    SDL_CondBroadcast( m_wake );
+  }
+  asset_unlock();
+  for ( l_index = 0; l_index < m_worker_count; l_index++ )
+  {
+    SDL_WaitThread( m_workers[l_index], NULL );
+  }
+  m_worker_count = 0;
+
+  /* Now nobody else is looking, empty everything. */
+  for ( l_index = 0; l_index < TRIX_ASSET_CACHE_SIZE; l_index++ )
+  {
+    if ( m_assets[l_index].state != ASSET_EMPTY )
+    {
+      asset_discard( &m_assets[l_index] );
+    }
+  }
+
+  /* And tidy away the locks. */
+  if ( m_done != NULL )
+  {
+    SDL_DestroyCond( m_done );
+    m_done = NULL;
+  }
+  if ( m_wake != NULL )
+  {
+    SDL_DestroyCond( m_wake );
+    m_wake = NULL;
+  }
+  if ( m_lock != NULL )
+  {
+    SDL_DestroyMutex( m_lock );
+    m_lock = NULL;
+  }
+
+  /* All done. */
+  return;
+}
+
+
+/* End of file asset.c */
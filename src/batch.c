@@ -0,0 +1,602 @@
+/*
+ * batch.c - part of Tessalatrix
+ *
+ * Steps many independent games in lockstep. Boards and falling pieces are
+ * held as row bitmasks in a structure-of-arrays layout (one row of every
+ * lane next to each other) so that collision tests, gravity, locking and
+ * full row detection can run across all lanes at once with SSE2 or AVX2,
+ * falling back to plain C where neither is available.
+ *
+ * Each call to batch_step() behaves, for every lane, exactly as core_step()
+ * does when handed that lane's input and a whole gravity interval; that is,
+ * the input is applied and then the piece falls a row (or locks).
+ *
+ * Copyright (c) 2023 Pete Favelle <ahnlak@ahnlak.com>
+ *
+ * This file is released under the MIT License; see LICENSE for details.
+ */
+
+/* System headers. */
+
+#include <stdint.h>
+#include <string.h>
+
+/* The plain C flavour can be asked for even where vectors are available, */
+/* so that it can still be checked on machines which have them.           */
+#if !defined(TRIX_BATCH_SCALAR) && defined(__AVX2__)
+#define   TRIX_BATCH_AVX2
+#elif !defined(TRIX_BATCH_SCALAR) && defined(__SSE2__)
+#define   TRIX_BATCH_SSE2
+#endif
+
+#if defined(TRIX_BATCH_AVX2) || defined(TRIX_BATCH_SSE2)
+#include <immintrin.h>
+#endif
+
+
+/* Local headers. */
+
+#include "trixcore.h"
+
+
+/*
+ * Vector helpers; a minimal set of operations on a vector of 16 bit lanes,
+ * in AVX2, SSE2 and scalar flavours. TRIX_VEC_LANES is the number of lanes
+ * each flavour handles at once.
+ */
+
+#if defined(TRIX_BATCH_AVX2)
+
+#define   TRIX_VEC_LANES  16
+typedef __m256i trix_vec_t;
+
+static inline trix_vec_t batch_vec_load( const trix_row_t *p_ptr )
+{
+  return _mm256_loadu_si256( (const __m256i *)p_ptr );
+}
+static inline void batch_vec_store( trix_row_t *p_ptr, trix_vec_t p_vec )
+{
+  _mm256_storeu_si256( (__m256i *)p_ptr, p_vec );
+}
+static inline trix_vec_t batch_vec_set( trix_row_t p_value )
+{
+  return _mm256_set1_epi16( (short)p_value );
+}
+static inline trix_vec_t batch_vec_and( trix_vec_t p_a, trix_vec_t p_b )
+{
+  return _mm256_and_si256( p_a, p_b );
+}
+static inline trix_vec_t batch_vec_or( trix_vec_t p_a, trix_vec_t p_b )
+{
+  return _mm256_or_si256( p_a, p_b );
+}
+static inline trix_vec_t batch_vec_andnot( trix_vec_t p_a, trix_vec_t p_b )
+{
+  return _mm256_andnot_si256( p_a, p_b );
+}
+static inline trix_vec_t batch_vec_cmpeq( trix_vec_t p_a, trix_vec_t p_b )
+{
+  return _mm256_cmpeq_epi16( p_a, p_b );
+}
+static inline trix_vec_t batch_vec_shl( trix_vec_t p_a )
+{
+  return _mm256_slli_epi16( p_a, 1 );
+}
+static inline trix_vec_t batch_vec_shr( trix_vec_t p_a )
+{
+  return _mm256_srli_epi16( p_a, 1 );
+}
+
+#elif defined(TRIX_BATCH_SSE2)
+
+#define   TRIX_VEC_LANES  8
+typedef __m128i trix_vec_t;
+
+static inline trix_vec_t batch_vec_load( const trix_row_t *p_ptr )
+{
+  return _mm_loadu_si128( (const __m128i *)p_ptr );
+}
+static inline void batch_vec_store( trix_row_t *p_ptr, trix_vec_t p_vec )
+{
+  _mm_storeu_si128( (__m128i *)p_ptr, p_vec );
+}
+static inline trix_vec_t batch_vec_set( trix_row_t p_value )
+{
+  return _mm_set1_epi16( (short)p_value );
+}
+static inline trix_vec_t batch_vec_and( trix_vec_t p_a, trix_vec_t p_b )
+{
+  return _mm_and_si128( p_a, p_b );
+}
+static inline trix_vec_t batch_vec_or( trix_vec_t p_a, trix_vec_t p_b )
+{
+  return _mm_or_si128( p_a, p_b );
+}
+static inline trix_vec_t batch_vec_andnot( trix_vec_t p_a, trix_vec_t p_b )
+{
+  return _mm_andnot_si128( p_a, p_b );
+}
+static inline trix_vec_t batch_vec_cmpeq( trix_vec_t p_a, trix_vec_t p_b )
+{
+  return _mm_cmpeq_epi16( p_a, p_b );
+}
+static inline trix_vec_t batch_vec_shl( trix_vec_t p_a )
+{
+  return _mm_slli_epi16( p_a, 1 );
+}
+static inline trix_vec_t batch_vec_shr( trix_vec_t p_a )
+{
+  return _mm_srli_epi16( p_a, 1 );
+}
+
+#else
+
+#define   TRIX_VEC_LANES  1
+typedef trix_row_t trix_vec_t;
+
+static inline trix_vec_t batch_vec_load( const trix_row_t *p_ptr )
+{
+  return *p_ptr;
+}
+static inline void batch_vec_store( trix_row_t *p_ptr, trix_vec_t p_vec )
+{
+  *p_ptr = p_vec;
+}
+static inline trix_vec_t batch_vec_set( trix_row_t p_value )
+{
+  return p_value;
+}
+static inline trix_vec_t batch_vec_and( trix_vec_t p_a, trix_vec_t p_b )
+{
+  return p_a & p_b;
+}
+static inline trix_vec_t batch_vec_or( trix_vec_t p_a, trix_vec_t p_b )
+{
+  return p_a | p_b;
+}
+static inline trix_vec_t batch_vec_andnot( trix_vec_t p_a, trix_vec_t p_b )
+{
+  return (trix_row_t)~p_a & p_b;
+}
+static inline trix_vec_t batch_vec_cmpeq( trix_vec_t p_a, trix_vec_t p_b )
+{
+  return p_a == p_b ? 0xFFFF : 0;
+}
+static inline trix_vec_t batch_vec_shl( trix_vec_t p_a )
+{
+  return (trix_row_t)( p_a << 1 );
+}
+static inline trix_vec_t batch_vec_shr( trix_vec_t p_a )
+{
+  return p_a >> 1;
+}
+
+#endif
+
+#if       TRIX_BATCH_LANES % TRIX_VEC_LANES != 0
+#error    "TRIX_BATCH_LANES must be a multiple of the vector width"
+#endif
+
+
+/*
+ * Static functions; a collection of things only built for use locally.
+ */
+
+/*
+ * vec_select - picks lanes from p_a where p_mask is set, p_b elsewhere.
+ */
+
+static inline trix_vec_t batch_vec_select( trix_vec_t p_mask, trix_vec_t p_a, trix_vec_t p_b )
+{
+  return batch_vec_or( batch_vec_and( p_mask, p_a ), batch_vec_andnot( p_mask, p_b ) );
+}
+
+
+/*
+ * lane_fits - the scalar collision check for a single lane; equivalent to
+ *             the core's check_space, against that lane's board rows.
+ */
+
+static bool batch_lane_fits( const trix_batch_st *p_batch, uint_fast8_t p_lane,
+                             const trix_piece_st *p_piece, uint_fast8_t p_rotation,
+                             trix_point_st p_location )
+{
+  uint_fast8_t              l_row;
+  int_fast8_t               l_left, l_top;
+  const trix_piece_mask_st *l_mask = &p_piece->masks[p_rotation];
+
+  /* Check that we're not off the board. */
+  l_left = p_location.x + l_mask->min_x;
+  l_top = p_location.y + l_mask->min_y + TRIX_BATCH_HIDDEN;
+  if ( ( l_left < 0 ) || ( p_location.x + l_mask->max_x >= p_batch->board_width ) ||
+       ( p_location.y + l_mask->max_y >= TRIX_BOARD_HEIGHT ) || ( l_top < 0 ) )
+  {
+    return false;
+  }
+
+  /* The hidden rows above the board are always empty, so no special cases. */
+  for( l_row = 0; l_row < l_mask->height; l_row++ )
+  {
+    if ( p_batch->board[l_top + l_row][p_lane] & ( l_mask->rows[l_row] << l_left ) )
+    {
+      return false;
+    }
+  }
+
+  /* No clashes, so it's a valid move. */
+  return true;
+}
+
+
+/*
+ * lane_place - writes the current piece of a lane into the piece plane, at
+ *              its current rotation and location.
+ */
+
+static void batch_lane_place( trix_batch_st *p_batch, uint_fast8_t p_lane )
+{
+  uint_fast8_t              l_row;
+  int_fast8_t               l_left, l_top;
+  const trix_piece_mask_st *l_mask;
+
+  /* Clear out wherever the piece used to be. */
+  for ( l_row = 0; l_row < TRIX_BATCH_ROWS; l_row++ )
+  {
+    p_batch->piece[l_row][p_lane] = 0;
+  }
+
+  /* And draw the rows of the mask in at the new position. */
+  l_mask = &p_batch->current[p_lane]->masks[p_batch->rotation[p_lane]];
+  l_left = p_batch->location[p_lane].x + l_mask->min_x;
+  l_top = p_batch->location[p_lane].y + l_mask->min_y + TRIX_BATCH_HIDDEN;
+  for ( l_row = 0; l_row < l_mask->height; l_row++ )
+  {
+    p_batch->piece[l_top + l_row][p_lane] = l_mask->rows[l_row] << l_left;
+  }
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * lane_clear_lines - the scalar line compaction for a single lane, only run
+ *                    on lanes where a full row has been spotted. Returns the
+ *                    number of lines cleared.
+ */
+
+static uint_fast8_t batch_lane_clear_lines( trix_batch_st *p_batch, uint_fast8_t p_lane )
+{
+  int_fast8_t   l_read, l_write;
+  uint_fast8_t  l_cleared = 0;
+
+  /* Work up the visible board, copying surviving rows over completed ones. */
+  for ( l_read = l_write = TRIX_BATCH_ROWS - 1; l_read >= TRIX_BATCH_HIDDEN; l_read-- )
+  {
+    if ( p_batch->board[l_read][p_lane] == 0 )
+    {
+      break;
+    }
+    if ( p_batch->board[l_read][p_lane] == p_batch->full_row )
+    {
+      l_cleared++;
+      continue;
+    }
+    p_batch->board[l_write--][p_lane] = p_batch->board[l_read][p_lane];
+  }
+
+  /* And empty whatever is left above. */
+  for ( ; l_write > l_read; l_write-- )
+  {
+    p_batch->board[l_write][p_lane] = 0;
+  }
+
+  return l_cleared;
+}
+
+
+/*
+ * shift - the vector kernel for sideways movement; lanes flagged in p_left
+ *         or p_right are moved, if they can be. The lanes which actually
+ *         moved are written back into those arrays.
+ */
+
+static void batch_shift( trix_batch_st *p_batch, trix_row_t *p_left, trix_row_t *p_right )
+{
+  uint_fast8_t  l_lane, l_row;
+  trix_vec_t    l_board, l_piece, l_block_left, l_block_right;
+  trix_vec_t    l_go_left, l_go_right;
+  const trix_vec_t l_zero = batch_vec_set( 0 );
+  const trix_vec_t l_left_wall = batch_vec_set( 1 );
+  const trix_vec_t l_right_wall = batch_vec_set( 1u << ( p_batch->board_width - 1 ) );
+
+  for ( l_lane = 0; l_lane < TRIX_BATCH_LANES; l_lane += TRIX_VEC_LANES )
+  {
+    /* Accumulate anything in the way of a move in either direction. */
+    l_block_left = l_block_right = l_zero;
+    for ( l_row = 0; l_row < TRIX_BATCH_ROWS; l_row++ )
+    {
+      l_board = batch_vec_load( &p_batch->board[l_row][l_lane] );
+      l_piece = batch_vec_load( &p_batch->piece[l_row][l_lane] );
+      l_block_left = batch_vec_or( l_block_left, batch_vec_and( l_piece, l_left_wall ) );
+      l_block_left = batch_vec_or( l_block_left, batch_vec_and( batch_vec_shr( l_piece ), l_board ) );
+      l_block_right = batch_vec_or( l_block_right, batch_vec_and( l_piece, l_right_wall ) );
+      l_block_right = batch_vec_or( l_block_right, batch_vec_and( batch_vec_shl( l_piece ), l_board ) );
+    }
+
+    /* Only move the lanes that want to, and are free to. */
+    l_go_left = batch_vec_and( batch_vec_load( &p_left[l_lane] ), batch_vec_cmpeq( l_block_left, l_zero ) );
+    l_go_right = batch_vec_and( batch_vec_load( &p_right[l_lane] ), batch_vec_cmpeq( l_block_right, l_zero ) );
+    for ( l_row = 0; l_row < TRIX_BATCH_ROWS; l_row++ )
+    {
+      l_piece = batch_vec_load( &p_batch->piece[l_row][l_lane] );
+      l_piece = batch_vec_select( l_go_left, batch_vec_shr( l_piece ),
+                                  batch_vec_select( l_go_right, batch_vec_shl( l_piece ), l_piece ) );
+      batch_vec_store( &p_batch->piece[l_row][l_lane], l_piece );
+    }
+    batch_vec_store( &p_left[l_lane], l_go_left );
+    batch_vec_store( &p_right[l_lane], l_go_right );
+  }
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * gravity - the vector kernel for falling; every live lane either moves its
+ *           piece down a row, or locks it into the board. Lanes that locked
+ *           are flagged in p_locked, and lanes which have completed at least
+ *           one row are flagged in p_full.
+ */
+
+static void batch_gravity( trix_batch_st *p_batch, const trix_row_t *p_live,
+                           trix_row_t *p_locked, trix_row_t *p_full )
+{
+  uint_fast8_t  l_lane, l_row;
+  trix_vec_t    l_blocked, l_fall, l_lock, l_full, l_board, l_piece, l_above;
+  const trix_vec_t l_zero = batch_vec_set( 0 );
+  const trix_vec_t l_full_row = batch_vec_set( p_batch->full_row );
+
+  for ( l_lane = 0; l_lane < TRIX_BATCH_LANES; l_lane += TRIX_VEC_LANES )
+  {
+    /* A piece is blocked by the floor, or by anything directly beneath it. */
+    l_blocked = batch_vec_load( &p_batch->piece[TRIX_BATCH_ROWS-1][l_lane] );
+    for ( l_row = 0; l_row < TRIX_BATCH_ROWS - 1; l_row++ )
+    {
+      l_blocked = batch_vec_or( l_blocked,
+                                batch_vec_and( batch_vec_load( &p_batch->piece[l_row][l_lane] ),
+                                               batch_vec_load( &p_batch->board[l_row+1][l_lane] ) ) );
+    }
+    l_fall = batch_vec_and( batch_vec_load( &p_live[l_lane] ), batch_vec_cmpeq( l_blocked, l_zero ) );
+    l_lock = batch_vec_andnot( l_fall, batch_vec_load( &p_live[l_lane] ) );
+
+    /* Work up from the bottom, moving falling pieces and locking the rest. */
+    l_full = l_zero;
+    for ( l_row = TRIX_BATCH_ROWS; l_row-- > 0; )
+    {
+      l_piece = batch_vec_load( &p_batch->piece[l_row][l_lane] );
+      l_above = l_row > 0 ? batch_vec_load( &p_batch->piece[l_row-1][l_lane] ) : l_zero;
+
+      /* Locking pieces are merged into the (visible) board. */
+      if ( l_row >= TRIX_BATCH_HIDDEN )
+      {
+        l_board = batch_vec_or( batch_vec_load( &p_batch->board[l_row][l_lane] ),
+                                batch_vec_and( l_lock, l_piece ) );
+        batch_vec_store( &p_batch->board[l_row][l_lane], l_board );
+        l_full = batch_vec_or( l_full, batch_vec_cmpeq( l_board, l_full_row ) );
+      }
+
+      /* Falling pieces take the row above; locked ones are removed. */
+      l_piece = batch_vec_select( l_fall, l_above, batch_vec_andnot( l_lock, l_piece ) );
+      batch_vec_store( &p_batch->piece[l_row][l_lane], l_piece );
+    }
+
+    batch_vec_store( &p_locked[l_lane], l_lock );
+    batch_vec_store( &p_full[l_lane], batch_vec_and( l_lock, l_full ) );
+  }
+
+  /* All done. */
+  return;
+}
+
+
+/* Functions. */
+
+/*
+ * init - starts a fresh game in every lane of the batch, each seeded from the
+ *        matching entry in p_seeds.
+ */
+
+void batch_init( trix_batch_st *p_batch, trix_gamemode_t p_mode, const uint64_t *p_seeds )
+{
+  uint_fast8_t  l_lane;
+
+  /* Empty boards all round, with no pieces yet in play. */
+  memset( p_batch, 0, sizeof( trix_batch_st ) );
+  p_batch->mode = p_mode;
+  p_batch->board_width = 10;
+  p_batch->full_row = ( 1u << p_batch->board_width ) - 1;
+
+  /* Every lane gets its own generator. */
+  for ( l_lane = 0; l_lane < TRIX_BATCH_LANES; l_lane++ )
+  {
+    rng_seed( &p_batch->rng[l_lane], p_seeds[l_lane] );
+  }
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * step - advances every lane by one gravity interval, applying that lane's
+ *        entry from p_inputs first. Returns a mask of the lanes whose games
+ *        are still running.
+ */
+
+uint_fast32_t batch_step( trix_batch_st *p_batch, const trix_input_t *p_inputs )
+{
+  uint_fast8_t  l_lane, l_rotation, l_cleared;
+  uint_fast32_t l_running = 0;
+  trix_point_st l_location;
+  trix_row_t    l_live[TRIX_BATCH_LANES];
+  trix_row_t    l_left[TRIX_BATCH_LANES];
+  trix_row_t    l_right[TRIX_BATCH_LANES];
+  trix_row_t    l_locked[TRIX_BATCH_LANES];
+  trix_row_t    l_full[TRIX_BATCH_LANES];
+
+  /* Sort out the inputs; rotations and drops are rare enough to be done */
+  /* one by one.                                                          */
+  for ( l_lane = 0; l_lane < TRIX_BATCH_LANES; l_lane++ )
+  {
+    l_live[l_lane] = l_left[l_lane] = l_right[l_lane] = 0;
+    if ( ( p_batch->over[l_lane] ) || ( p_batch->current[l_lane] == NULL ) )
+    {
+      continue;
+    }
+    l_live[l_lane] = 0xFFFF;
+
+    switch( p_inputs[l_lane] )
+    {
+      case INPUT_LEFT:
+        l_left[l_lane] = 0xFFFF;
+        break;
+      case INPUT_RIGHT:
+        l_right[l_lane] = 0xFFFF;
+        break;
+      case INPUT_ROTATE:
+        l_rotation = p_batch->rotation[l_lane] >= 3 ? 0 : p_batch->rotation[l_lane]+1;
+        if ( batch_lane_fits( p_batch, l_lane, p_batch->current[l_lane], l_rotation,
+                              p_batch->location[l_lane] ) )
+        {
+          p_batch->rotation[l_lane] = l_rotation;
+          batch_lane_place( p_batch, l_lane );
+        }
+        break;
+      case INPUT_DROP:
+        /* Hard drops go straight to the bottom, for gravity to lock. */
+        l_location = p_batch->location[l_lane];
+        do
+        {
+          l_location.y++;
+        } while ( batch_lane_fits( p_batch, l_lane, p_batch->current[l_lane],
+                                   p_batch->rotation[l_lane], l_location ) );
+        if ( l_location.y - 1 != p_batch->location[l_lane].y )
+        {
+          p_batch->location[l_lane].y = l_location.y - 1;
+          batch_lane_place( p_batch, l_lane );
+        }
+        break;
+      case INPUT_SHIFT_LEFT:
+      case INPUT_SHIFT_RIGHT:
+        /* Slides go as far as they can, one lane at a time. */
+        l_location = p_batch->location[l_lane];
+        do
+        {
+          l_location.x += p_inputs[l_lane] == INPUT_SHIFT_LEFT ? -1 : 1;
+        } while ( batch_lane_fits( p_batch, l_lane, p_batch->current[l_lane],
+                                   p_batch->rotation[l_lane], l_location ) );
+        l_location.x -= p_inputs[l_lane] == INPUT_SHIFT_LEFT ? -1 : 1;
+        if ( l_location.x != p_batch->location[l_lane].x )
+        {
+          p_batch->location[l_lane].x = l_location.x;
+          batch_lane_place( p_batch, l_lane );
+        }
+        break;
+      default:
+        break;
+    }
+  }
+
+  /* Sideways movement and gravity run across all the lanes together. */
+  batch_shift( p_batch, l_left, l_right );
+  batch_gravity( p_batch, l_live, l_locked, l_full );
+
+  /* Then tidy up the per-lane bookkeeping. */
+  for ( l_lane = 0; l_lane < TRIX_BATCH_LANES; l_lane++ )
+  {
+    /* Finished games stay finished. */
+    if ( p_batch->over[l_lane] )
+    {
+      continue;
+    }
+
+    /* Follow whatever the kernels did to the piece. */
+    if ( l_left[l_lane] )
+    {
+      p_batch->location[l_lane].x--;
+    }
+    if ( l_right[l_lane] )
+    {
+      p_batch->location[l_lane].x++;
+    }
+    if ( l_live[l_lane] && !l_locked[l_lane] )
+    {
+      p_batch->location[l_lane].y++;
+    }
+
+    /* Locked pieces score, and may have completed lines. */
+    if ( l_locked[l_lane] )
+    {
+      p_batch->score[l_lane] += p_batch->current[l_lane]->value;
+      p_batch->current[l_lane] = NULL;
+      if ( l_full[l_lane] )
+      {
+        l_cleared = batch_lane_clear_lines( p_batch, l_lane );
+        p_batch->lines[l_lane] += l_cleared;
+        p_batch->score[l_lane] += 10 * l_cleared;
+      }
+    }
+
+    /* Lanes without a piece need a fresh one. */
+    if ( p_batch->current[l_lane] == NULL )
+    {
+      p_batch->current[l_lane] = piece_select( p_batch->mode, &p_batch->rng[l_lane] );
+      if ( p_batch->current[l_lane] == NULL )
+      {
+        p_batch->over[l_lane] = true;
+        continue;
+      }
+      p_batch->location[l_lane].x = ( p_batch->board_width / 2 ) - 1;
+      p_batch->location[l_lane].y = -1;
+      p_batch->rotation[l_lane] = rng_range( &p_batch->rng[l_lane], 4 );
+
+      /* If it doesn't fit, that lane's game is over. */
+      if ( !batch_lane_fits( p_batch, l_lane, p_batch->current[l_lane],
+                             p_batch->rotation[l_lane], p_batch->location[l_lane] ) )
+      {
+        p_batch->over[l_lane] = true;
+        continue;
+      }
+      batch_lane_place( p_batch, l_lane );
+    }
+
+    /* Still going, then. */
+    l_running |= ( UINT32_C(1) << l_lane );
+  }
+
+  return l_running;
+}
+
+
+/*
+ * get_rows - copies out the board of a single lane, in the same row format
+ *            as trix_gamestate_st uses.
+ */
+
+void batch_get_rows( const trix_batch_st *p_batch, uint_fast8_t p_lane, trix_row_t *p_rows )
+{
+  uint_fast8_t  l_row;
+
+  for ( l_row = 0; l_row < TRIX_BOARD_HEIGHT; l_row++ )
+  {
+    p_rows[l_row] = p_batch->board[l_row + TRIX_BATCH_HIDDEN][p_lane];
+  }
+
+  /* All done. */
+  return;
+}
+
+
+/* End of file batch.c */
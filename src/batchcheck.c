@@ -0,0 +1,177 @@
+/*
+ * batchcheck.c - part of Tessalatrix
+ *
+ * trix_batchcheck; a headless check that the batch stepper still plays the
+ * same game as the core. Every lane of a batch is shadowed by its own core,
+ * seeded the same way, and both are fed the same random inputs; after each
+ * step the boards, pieces and scores must match exactly. It is built once
+ * for each flavour of vector code batch.c has, so that none of them can
+ * quietly drift away from core.c.
+ *
+ * Copyright (c) 2023 Pete Favelle <ahnlak@ahnlak.com>
+ *
+ * This file is released under the MIT License; see LICENSE for details.
+ */
+
+/* System headers. */
+
+#include <stdio.h>
+#include <string.h>
+
+
+/* Local headers. */
+
+#include "trixcore.h"
+
+
+/* Constants. */
+
+#define   TRIX_BATCHCHECK_BATCHES     16
+#define   TRIX_BATCHCHECK_ROUNDS      1000
+#define   TRIX_BATCHCHECK_SKIPPED     77
+
+
+/* Module variables. */
+
+static trix_batch_st  m_batch;
+static trix_core_st   m_cores[TRIX_BATCH_LANES];
+
+
+/*
+ * Static functions; a collection of things only built for use locally.
+ */
+
+/*
+ * compare - checks that a single lane of the batch matches its core, logging
+ *           the first difference found. Returns false if they differ.
+ */
+
+static bool batchcheck_compare( uint_fast8_t p_lane, uint_fast32_t p_round )
+{
+  const trix_gamestate_st  *l_state = core_state( &m_cores[p_lane] );
+  trix_row_t                l_rows[TRIX_BOARD_HEIGHT];
+
+  batch_get_rows( &m_batch, p_lane, l_rows );
+  if ( memcmp( l_rows, l_state->rows, sizeof( l_rows ) ) != 0 )
+  {
+    printf( "Lane %u, round %lu: boards differ\n", (unsigned)p_lane, (unsigned long)p_round );
+    return false;
+  }
+  if ( ( m_batch.score[p_lane] != l_state->score ) || ( m_batch.lines[p_lane] != l_state->lines ) )
+  {
+    printf( "Lane %u, round %lu: score %lu/%lu, lines %lu/%lu\n",
+            (unsigned)p_lane, (unsigned long)p_round,
+            (unsigned long)m_batch.score[p_lane], (unsigned long)l_state->score,
+            (unsigned long)m_batch.lines[p_lane], (unsigned long)l_state->lines );
+    return false;
+  }
+  if ( ( m_batch.current[p_lane] != l_state->piece ) ||
+       ( m_batch.rotation[p_lane] != l_state->rotation ) ||
+       ( m_batch.location[p_lane].x != l_state->location.x ) ||
+       ( m_batch.location[p_lane].y != l_state->location.y ) )
+  {
+    printf( "Lane %u, round %lu: falling pieces differ\n", (unsigned)p_lane, (unsigned long)p_round );
+    return false;
+  }
+
+  return true;
+}
+
+
+/*
+ * run - plays a single batch alongside its cores, from the given seed.
+ *       Returns false at the first difference between them.
+ */
+
+static bool batchcheck_run( uint64_t p_seed )
+{
+  trix_rng_st     l_rng;
+  trix_input_t    l_inputs[TRIX_BATCH_LANES];
+  uint64_t        l_seeds[TRIX_BATCH_LANES];
+  uint_fast32_t   l_running, l_round;
+  uint_fast32_t   l_alive = ( UINT32_C(1) << TRIX_BATCH_LANES ) - 1;
+  uint_fast8_t    l_lane;
+
+  /* Seed every lane, and its core, from the batch seed. */
+  rng_seed( &l_rng, p_seed );
+  for ( l_lane = 0; l_lane < TRIX_BATCH_LANES; l_lane++ )
+  {
+    l_seeds[l_lane] = ( (uint64_t)rng_next( &l_rng ) << 32 ) | rng_next( &l_rng );
+    core_init( &m_cores[l_lane], GAME_MODE_STANDARD, l_seeds[l_lane] );
+    l_inputs[l_lane] = INPUT_NONE;
+  }
+  batch_init( &m_batch, GAME_MODE_STANDARD, l_seeds );
+
+  /* The first step just spawns a piece in every lane, as it does for a core. */
+  for ( l_round = 0; l_round <= TRIX_BATCHCHECK_ROUNDS && l_alive != 0; l_round++ )
+  {
+    l_running = batch_step( &m_batch, l_inputs );
+    for ( l_lane = 0; l_lane < TRIX_BATCH_LANES; l_lane++ )
+    {
+      if ( ( l_alive & ( UINT32_C(1) << l_lane ) ) == 0 )
+      {
+        continue;
+      }
+      if ( !core_step( &m_cores[l_lane], l_inputs[l_lane],
+                       l_round == 0 ? 0 : m_cores[l_lane].drop_speed ) )
+      {
+        l_alive &= ~( UINT32_C(1) << l_lane );
+      }
+
+      /* Both sides must agree on whether the game goes on, and on how. */
+      if ( ( ( l_running ^ l_alive ) & ( UINT32_C(1) << l_lane ) ) != 0 )
+      {
+        printf( "Lane %u, round %lu: only one side's game is over\n",
+                (unsigned)l_lane, (unsigned long)l_round );
+        return false;
+      }
+      if ( ( l_alive & ( UINT32_C(1) << l_lane ) ) && !batchcheck_compare( l_lane, l_round ) )
+      {
+        return false;
+      }
+
+      /* And then pick the next input for this lane. */
+      l_inputs[l_lane] = (trix_input_t)rng_range( &l_rng, INPUT_MAX );
+    }
+  }
+
+  return true;
+}
+
+
+/*
+ * Main entry point.
+ */
+
+int main( int argc, char **argv )
+{
+  uint_fast32_t l_batch;
+
+#if defined(__AVX2__) && ( defined(__GNUC__) || defined(__clang__) )
+  /* No point trying AVX2 on a processor that doesn't have it. */
+  if ( !__builtin_cpu_supports( "avx2" ) )
+  {
+    printf( "No AVX2 support here, skipping\n" );
+    return TRIX_BATCHCHECK_SKIPPED;
+  }
+#endif
+
+  /* Both sides need their piece masks. */
+  piece_init();
+
+  for ( l_batch = 0; l_batch < TRIX_BATCHCHECK_BATCHES; l_batch++ )
+  {
+    if ( !batchcheck_run( l_batch + 1 ) )
+    {
+      printf( "Batch %lu does not match the core\n", (unsigned long)l_batch );
+      return 1;
+    }
+  }
+
+  printf( "%u batches of %u lanes match the core\n",
+          (unsigned)TRIX_BATCHCHECK_BATCHES, (unsigned)TRIX_BATCH_LANES );
+  return 0;
+}
+
+
+/* End of file batchcheck.c */
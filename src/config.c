@@ -240,6 +240,14 @@ bool config_load( int p_argc, char **p_argv )
     {"version",  'v', OPTPARSE_NONE},
     {"help",     'h', OPTPARSE_NONE},
     {"loglevel", 'l', OPTPARSE_REQUIRED},
+    {"seed",     's', OPTPARSE_REQUIRED},
+    {"autoplay", 'a', OPTPARSE_NONE},
+    {"preview",  'p', OPTPARSE_REQUIRED},
+    {"rollouts", 'r', OPTPARSE_REQUIRED},
+    {"das",      'd', OPTPARSE_REQUIRED},
+    {"arr",      'R', OPTPARSE_REQUIRED},
+    {"vsync",    'V', OPTPARSE_REQUIRED},
+    {"budget",   'b', OPTPARSE_REQUIRED},
     {0}
   };
 
@@ -248,6 +256,14 @@ bool config_load( int p_argc, char **p_argv )
   config_set_string( CONF_LOG_FILENAME, "tessalatrix.log", false );
   config_set_int( CONF_RESOLUTION, 0, true );
   config_set_string( CONF_PLAYERNAME, "Player1", true );
+  config_set_int( CONF_SEED, 0, false );
+  config_set_int( CONF_AUTOPLAY, 0, false );
+  config_set_int( CONF_AI_PREVIEW, 1, false );
+  config_set_int( CONF_AI_ROLLOUTS, 0, false );
+  config_set_int( CONF_DAS, TRIX_DAS_MS, true );
+  config_set_int( CONF_ARR, TRIX_ARR_MS, true );
+  config_set_int( CONF_VSYNC, 0, true );
+  config_set_int( CONF_ASSET_BUDGET, 0, true );
 
   /* Load up any configuration file we can find. */
   config_fetch();
@@ -296,6 +312,38 @@ bool config_load( int p_argc, char **p_argv )
           l_retval = false;
         }
         break;
+      /* Set a fixed seed, so every game plays the same piece sequence. */
+      case 's':
+        config_set_int( CONF_SEED, atoi( l_opt_struct.optarg ), false );
+        break;
+      /* Go straight into the autoplayer, for unattended soak runs. */
+      case 'a':
+        config_set_int( CONF_AUTOPLAY, 1, false );
+        break;
+      /* How many upcoming pieces the autoplayer may look ahead at. */
+      case 'p':
+        config_set_int( CONF_AI_PREVIEW, atoi( l_opt_struct.optarg ), false );
+        break;
+      /* Have the autoplayer decide by rollouts, rather than by search. */
+      case 'r':
+        config_set_int( CONF_AI_ROLLOUTS, atoi( l_opt_struct.optarg ), false );
+        break;
+      /* How long a sideways key is held before it starts to repeat... */
+      case 'd':
+        config_set_int( CONF_DAS, atoi( l_opt_struct.optarg ), true );
+        break;
+      /* ...and how often it repeats after that. */
+      case 'R':
+        config_set_int( CONF_ARR, atoi( l_opt_struct.optarg ), true );
+        break;
+      /* Whether to leave frame timing to the display's vsync. */
+      case 'V':
+        config_set_int( CONF_VSYNC, atoi( l_opt_struct.optarg ) != 0, true );
+        break;
+      /* How much texture memory to keep hold of, for assets not in use. */
+      case 'b':
+        config_set_int( CONF_ASSET_BUDGET, atoi( l_opt_struct.optarg ), true );
+        break;
       /* Handle any errors. */
       case '?':
         printf( "Tessalatrix error: %s\n", l_opt_struct.errmsg );
@@ -308,7 +356,18 @@ bool config_load( int p_argc, char **p_argv )
         printf( "\nUsage: %s [OPTIONS]\nwhere [OPTIONS] is one or more of:\n\n", p_argv[0] );
         printf( "-v, --version      display version number, and exit\n" );
         printf( "-h, --help         display this help text, and exit\n" );
-        printf( "-l, --loglevel=LVL sets the desired logging level - must be one of ALWAYS, ERROR, WARN, LOG or TRACE\n\n" );
+        printf( "-l, --loglevel=LVL sets the desired logging level - must be one of ALWAYS, ERROR, WARN, LOG or TRACE\n" );
+        printf( "-s, --seed=N       seeds every game with N, for a repeatable piece sequence\n" );
+        printf( "-a, --autoplay     skips the menu and lets the autoplayer play, until interrupted\n" );
+        printf( "-p, --preview=N    lets the autoplayer look N pieces ahead (0 to %d, default 1)\n", TRIX_SEARCH_DEPTH_MAX );
+        printf( "-r, --rollouts=N   has the autoplayer decide by N rollouts per move, on all cores;\n" );
+        printf( "                   much stronger, but only for machines with plenty of cores\n" );
+        printf( "-d, --das=MS       holds sideways keys for MS milliseconds before they repeat (default %d)\n", TRIX_DAS_MS );
+        printf( "-R, --arr=MS       repeats held sideways keys every MS milliseconds (default %d);\n", TRIX_ARR_MS );
+        printf( "                   0 moves the piece as far as it can go straight away\n" );
+        printf( "-V, --vsync=N      1 syncs frames to the display's refresh, 0 paces them to %d fps\n", TRIX_FPS_RATE );
+        printf( "-b, --budget=KB    keeps no more than KB kilobytes of loaded images in memory;\n" );
+        printf( "                   0 (the default) keeps everything that has been loaded\n\n" );
         l_retval = false;
         break;
     }
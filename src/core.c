@@ -0,0 +1,609 @@
+/*
+ * core.c - part of Tessalatrix
+ *
+ * The game simulation itself; the board, the falling piece and the rules
+ * that govern them. Nothing in here knows anything about SDL - it is driven
+ * purely by inputs and the passing of time, so that it can be run just as
+ * happily without a display as with one. All state lives in the caller's
+ * trix_core_st, so any number of games can be run side by side (and from
+ * different threads).
+ *
+ * Copyright (c) 2023 Pete Favelle <ahnlak@ahnlak.com>
+ *
+ * This file is released under the MIT License; see LICENSE for details.
+ */
+
+/* System headers. */
+
+#include <stdint.h>
+#include <string.h>
+
+
+/* Local headers. */
+
+#include "trixcore.h"
+
+
+/*
+ * Static functions; a collection of things only built for use locally.
+ */
+
+/*
+ * count_bits - counts the set bits in a mask; there are never many.
+ */
+
+static uint_fast8_t core_count_bits( uint_fast32_t p_mask )
+{
+  uint_fast8_t  l_count;
+
+  for ( l_count = 0; p_mask != 0; l_count++ )
+  {
+    p_mask &= p_mask - 1;
+  }
+
+  return l_count;
+}
+
+
+/*
+ * init_board - called at the start of a game, to initialise the board ready
+ *              to be played. This involves selecting the correct board width
+ *              for our game type, and making sure it's empty. The board is
+ *              held as one occupancy bitmask per row (bit n being column n)
+ *              alongside a row-major plane of the pieces for rendering. Some
+ *              metadata is kept up to date alongside it, so that nobody has
+ *              to rescan the board; how many cells of each row are filled,
+ *              the surface (the topmost occupied row in each column, or the
+ *              board height if the column is empty) and the number of holes
+ *              (empty cells with something above them).
+ */
+
+static void core_init_board( trix_core_st *p_core )
+{
+  /* For now, we only understand four-block pieces. */
+  p_core->state.board_width = 10;
+  p_core->state.full_row = ( 1u << p_core->state.board_width ) - 1;
+
+  /* Empty both the occupancy rows and the colour plane. */
+  memset( p_core->state.rows, 0, sizeof( p_core->state.rows ) );
+  memset( p_core->state.cells, PIECE_NONE, sizeof( p_core->state.cells ) );
+  p_core->state.cleared_rows = 0;
+
+  /* And the metadata to match. */
+  memset( p_core->state.fill, 0, sizeof( p_core->state.fill ) );
+  memset( p_core->state.surface, TRIX_BOARD_HEIGHT, sizeof( p_core->state.surface ) );
+  p_core->state.holes = 0;
+
+  /* Reset our game parameters. */
+  p_core->state.piece = NULL;
+  p_core->drop_speed = TRIX_BASE_DROP_MS;
+  p_core->state.score = p_core->state.lines = 0;
+  p_core->state.pieces = 0;
+}
+
+
+/*
+ * copy_to_board - adds the specified piece to the game board, if possible,
+ *                 updating the metadata for just the cells it fills.
+ */
+
+static bool core_copy_to_board( trix_core_st *p_core, const trix_piece_st *p_piece,
+                                uint_fast8_t p_rotation, trix_point_st p_location )
+{
+  uint_fast8_t  l_index;
+  trix_point_st l_block_loc;
+
+  /* Sanity check that we can do this. */
+  if ( !core_check_space( p_core, p_piece, p_rotation, p_location ) )
+  {
+    return false;
+  }
+
+  /* Good; should be a simple process then. */
+  for( l_index = 0; l_index < p_piece->block_count; l_index++ )
+  {
+    /* Work out the block address. */
+    l_block_loc.x = p_location.x + p_piece->blocks[p_rotation][l_index].x;
+    l_block_loc.y = p_location.y + p_piece->blocks[p_rotation][l_index].y;
+
+    /* Blocks above the top simply vanish. */
+    if ( l_block_loc.y < 0 )
+    {
+      continue;
+    }
+
+    /* And add it to the board. */
+    p_core->state.rows[l_block_loc.y] |= ( 1u << l_block_loc.x );
+    p_core->state.cells[l_block_loc.y][l_block_loc.x] = p_piece->piece;
+    p_core->state.fill[l_block_loc.y]++;
+
+    /* A block above the surface covers any gap down to it, making holes; */
+    /* below it, the block can only be filling a hole in.                 */
+    if ( l_block_loc.y < p_core->state.surface[l_block_loc.x] )
+    {
+      p_core->state.holes += p_core->state.surface[l_block_loc.x] - l_block_loc.y - 1;
+      p_core->state.surface[l_block_loc.x] = l_block_loc.y;
+    }
+    else
+    {
+      p_core->state.holes--;
+    }
+  }
+
+  /* All good then! */
+  return true;
+}
+
+
+/*
+ * clear_lines - removes any completed lines from the board; only the rows
+ *               between p_top and p_bottom (where the last piece landed) can
+ *               have been completed, so only they are checked. Rows are then
+ *               compacted in a single stable pass upwards from the lowest
+ *               completed one; each surviving row is moved at most once,
+ *               however many lines were completed. The (pre-clear) rows that
+ *               were removed are flagged in cleared_rows, and the count of
+ *               cleared lines is returned.
+ */
+
+static uint_fast8_t core_clear_lines( trix_core_st *p_core, int_fast16_t p_top, int_fast16_t p_bottom )
+{
+  int_fast8_t   l_read, l_write;
+  uint_fast8_t  l_column, l_surface, l_cleared = 0;
+  trix_row_t    l_bit;
+
+  /* Forget about any previous clears, and look for new ones. */
+  p_core->state.cleared_rows = 0;
+  for ( l_read = p_top < 0 ? 0 : p_top; l_read <= p_bottom; l_read++ )
+  {
+    if ( p_core->state.fill[l_read] == p_core->state.board_width )
+    {
+      p_core->state.cleared_rows |= ( UINT32_C(1) << l_read );
+      l_cleared++;
+      l_write = l_read;
+    }
+  }
+  if ( l_cleared == 0 )
+  {
+    return 0;
+  }
+
+  /* Before anything moves, work out where each surface will end up; if the */
+  /* surface itself is cleared, the holes down to the next block go with it. */
+  for ( l_column = 0; l_column < p_core->state.board_width; l_column++ )
+  {
+    l_surface = p_core->state.surface[l_column];
+    if ( ( l_surface < TRIX_BOARD_HEIGHT ) &&
+         ( p_core->state.cleared_rows & ( UINT32_C(1) << l_surface ) ) )
+    {
+      l_bit = 1u << l_column;
+      for ( l_surface++; l_surface < TRIX_BOARD_HEIGHT; l_surface++ )
+      {
+        if ( p_core->state.cleared_rows & ( UINT32_C(1) << l_surface ) )
+        {
+          continue;
+        }
+        if ( p_core->state.rows[l_surface] & l_bit )
+        {
+          break;
+        }
+        p_core->state.holes--;
+      }
+    }
+
+    /* Whatever's left drops by the number of rows cleared beneath it. */
+    if ( l_surface < TRIX_BOARD_HEIGHT )
+    {
+      l_surface += core_count_bits( p_core->state.cleared_rows >> ( l_surface + 1 ) );
+    }
+    p_core->state.surface[l_column] = l_surface;
+  }
+
+  /* Work up the board from the lowest completed row, copying surviving */
+  /* rows down over any completed ones.                                 */
+  for ( l_read = l_write; l_read >= 0; l_read-- )
+  {
+    /* Pieces always rest on something, so nothing sits above an empty row. */
+    if ( p_core->state.rows[l_read] == 0 )
+    {
+      break;
+    }
+
+    /* Completed rows are simply skipped over. */
+    if ( p_core->state.cleared_rows & ( UINT32_C(1) << l_read ) )
+    {
+      continue;
+    }
+
+    /* Surviving rows only need moving if something below has been cleared. */
+    if ( l_write != l_read )
+    {
+      p_core->state.rows[l_write] = p_core->state.rows[l_read];
+      p_core->state.fill[l_write] = p_core->state.fill[l_read];
+      memcpy( p_core->state.cells[l_write], p_core->state.cells[l_read],
+              sizeof( p_core->state.cells[0] ) );
+    }
+    l_write--;
+  }
+
+  /* Anything between the last written row and the old top is now empty. */
+  for ( ; l_write > l_read; l_write-- )
+  {
+    p_core->state.rows[l_write] = 0;
+    p_core->state.fill[l_write] = 0;
+    memset( p_core->state.cells[l_write], PIECE_NONE, sizeof( p_core->state.cells[0] ) );
+  }
+
+  /* Return the number of lines we cleared. */
+  return l_cleared;
+}
+
+
+/*
+ * shift_limit - works out how far the current piece can slide sideways in
+ *               the given direction (-1 for left, 1 for right), returning the
+ *               x location it would end up at. Each column slid is just a
+ *               bounds check and a row AND per row of the piece, so even a
+ *               slide right across the board is cheap enough for one step.
+ */
+
+static int_fast8_t core_shift_limit( const trix_core_st *p_core, int_fast8_t p_direction )
+{
+  const trix_piece_mask_st *l_mask = &p_core->state.piece->masks[p_core->state.rotation];
+  uint_fast8_t              l_row;
+  int_fast8_t               l_left, l_right, l_top;
+
+  l_left = p_core->state.location.x + l_mask->min_x;
+  l_right = p_core->state.location.x + l_mask->max_x;
+  l_top = p_core->state.location.y + l_mask->min_y;
+
+  /* Keep going while the piece stays on the board... */
+  while ( ( l_left + p_direction >= 0 ) &&
+          ( l_right + p_direction < p_core->state.board_width ) )
+  {
+    /* ...and none of its rows run into anything. */
+    for ( l_row = 0; l_row < l_mask->height; l_row++ )
+    {
+      if ( ( l_top + l_row >= 0 ) &&
+           ( p_core->state.rows[l_top + l_row] & ( l_mask->rows[l_row] << ( l_left + p_direction ) ) ) )
+      {
+        return l_left - l_mask->min_x;
+      }
+    }
+    l_left += p_direction;
+    l_right += p_direction;
+  }
+
+  return l_left - l_mask->min_x;
+}
+
+
+/* Functions. */
+
+/*
+ * init - starts a fresh game in the requested mode, with an empty board. The
+ *        seed determines the entire sequence of pieces in the game.
+ */
+
+void core_init( trix_core_st *p_core, trix_gamemode_t p_mode, uint64_t p_seed )
+{
+  /* Seed this game's own random number generator. */
+  rng_seed( &p_core->rng, p_seed );
+
+  /* Initialise the board, suitable for the game mode. */
+  p_core->state.mode = p_mode;
+  core_init_board( p_core );
+
+  /* Time starts from zero for every game. */
+  p_core->current_tick = p_core->last_drop_tick = 0;
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * step - advances the game by the given number of milliseconds, applying the
+ *        provided input first. Returns false once the game is over.
+ */
+
+bool core_step( trix_core_st *p_core, trix_input_t p_input, uint_fast32_t p_delta )
+{
+  const trix_piece_mask_st *l_mask;
+  uint_fast8_t              l_cleared;
+  uint_fast8_t              l_new_rotation;
+  uint_fast32_t             l_fall;
+  trix_point_st             l_new_location;
+  bool                      l_lock = false;
+
+  /* Move the clock on. */
+  p_core->current_tick += p_delta;
+
+  /* Process the input, if there is a piece to apply it to. */
+  switch( p_core->state.piece == NULL ? INPUT_NONE : p_input )
+  {
+    case INPUT_LEFT:                                      /* Move left. */
+    case INPUT_RIGHT:                                    /* Move right. */
+      /* Work out the new position. */
+      l_new_location.x = p_core->state.location.x + ( p_input == INPUT_LEFT ? -1 : 1 );
+      l_new_location.y = p_core->state.location.y;
+
+      /* Check that we'll fit. */
+      if ( core_check_space( p_core, p_core->state.piece, p_core->state.rotation, l_new_location ) )
+      {
+        p_core->state.location.x = l_new_location.x;
+      }
+      break;
+    case INPUT_SHIFT_LEFT:                       /* All the way left. */
+    case INPUT_SHIFT_RIGHT:                     /* All the way right. */
+      p_core->state.location.x = core_shift_limit( p_core, p_input == INPUT_SHIFT_LEFT ? -1 : 1 );
+      break;
+    case INPUT_ROTATE:                                       /* Rotate. */
+      /* Work out the new position. */
+      l_new_rotation = p_core->state.rotation >= 3 ? 0 : p_core->state.rotation+1;
+
+      /* Check that we'll fit. */
+      if ( core_check_space( p_core, p_core->state.piece, l_new_rotation, p_core->state.location ) )
+      {
+        p_core->state.rotation = l_new_rotation;
+      }
+      break;
+    case INPUT_DROP:                                           /* Drop. */
+      /* Straight down to wherever it would land, and lock it there. */
+      p_core->state.location = core_landing( p_core, p_core->state.piece,
+                                             p_core->state.rotation, p_core->state.location );
+      l_lock = true;
+      break;
+    default:
+      break;
+  }
+
+  /* If it's time for gravity to take the piece down, do so; at high speeds */
+  /* that may be several rows at once, but never further than it can land. */
+  if ( ( p_core->state.piece != NULL ) && ( !l_lock ) &&
+       ( p_core->current_tick >= ( p_core->last_drop_tick + p_core->drop_speed ) ) )
+  {
+    l_fall = ( p_core->current_tick - p_core->last_drop_tick ) / p_core->drop_speed;
+    l_new_location = core_landing( p_core, p_core->state.piece,
+                                   p_core->state.rotation, p_core->state.location );
+
+    /* If it can fall that far, it does; otherwise it lands, and locks. */
+    if ( (uint_fast32_t)( l_new_location.y - p_core->state.location.y ) >= l_fall )
+    {
+      p_core->state.location.y += l_fall;
+      p_core->last_drop_tick = p_core->current_tick;
+    }
+    else
+    {
+      p_core->state.location = l_new_location;
+      l_lock = true;
+    }
+  }
+
+  /* A piece that's been locked is transferred to the board, to make way for */
+  /* a fresh one.                                                             */
+  if ( l_lock )
+  {
+    l_mask = &p_core->state.piece->masks[p_core->state.rotation];
+    core_copy_to_board( p_core, p_core->state.piece, p_core->state.rotation, p_core->state.location );
+    p_core->state.score += p_core->state.piece->value;
+    p_core->state.piece = NULL;
+
+    /* This is probably a good time to check for any completed lines. */
+    l_cleared = core_clear_lines( p_core, p_core->state.location.y + l_mask->min_y,
+                                  p_core->state.location.y + l_mask->max_y );
+    p_core->state.lines += l_cleared;
+    p_core->state.score += 10 * l_cleared;
+  }
+
+  /* If we don't have a current piece, we should probably pick one. */
+  if ( p_core->state.piece == NULL )
+  {
+    p_core->state.piece = piece_select( p_core->state.mode, &p_core->rng );
+    if ( p_core->state.piece == NULL )
+    {
+      return false;
+    }
+    p_core->state.location = core_spawn_location( p_core );
+    p_core->state.rotation = rng_range( &p_core->rng, 4 );
+    p_core->state.pieces++;
+    p_core->last_drop_tick = p_core->current_tick;
+
+    /* Now check to see if that fit; if it didn't, the game is over. */
+    if ( !core_check_space( p_core, p_core->state.piece, p_core->state.rotation, p_core->state.location ) )
+    {
+      return false;
+    }
+  }
+
+  /* Keep track of where the piece would land, for anyone drawing a ghost. */
+  p_core->state.landing = core_landing( p_core, p_core->state.piece,
+                                        p_core->state.rotation, p_core->state.location );
+
+  /* The game goes on. */
+  return true;
+}
+
+
+/*
+ * place - moves the current piece straight to the given (resting) placement
+ *         and drops it there, exactly as it would lock in play; lines
+ *         are cleared, the score updated and the next piece spawned. This is
+ *         for headless play, where nobody needs to watch the piece fall.
+ *         Returns false once the game is over.
+ */
+
+bool core_place( trix_core_st *p_core, uint_fast8_t p_rotation, trix_point_st p_location )
+{
+  /* Put the piece in place, so long as there is one. */
+  if ( p_core->state.piece != NULL )
+  {
+    p_core->state.rotation = p_rotation;
+    p_core->state.location = p_location;
+  }
+
+  /* And step on far enough for gravity to take it. */
+  return core_step( p_core, INPUT_DROP, p_core->drop_speed );
+}
+
+
+/*
+ * next_drop - returns how many milliseconds there are until gravity is next
+ *             due to move the current piece, so that anything driving the
+ *             game knows when it next needs stepping. With no piece yet, one
+ *             is due straight away.
+ */
+
+uint_fast32_t core_next_drop( const trix_core_st *p_core )
+{
+  if ( ( p_core->state.piece == NULL ) ||
+       ( p_core->current_tick >= p_core->last_drop_tick + p_core->drop_speed ) )
+  {
+    return 0;
+  }
+  return p_core->last_drop_tick + p_core->drop_speed - p_core->current_tick;
+}
+
+
+/*
+ * check_space - a simple boolean flag to show if a given piece / rotation /
+ *               location can fit onto the game board. This works on the
+ *               precalculated masks, so is a bounds check and a handful of
+ *               row ANDs. Exposed so that anything planning moves can use
+ *               exactly the same rules as the game itself.
+ */
+
+bool core_check_space( const trix_core_st *p_core, const trix_piece_st *p_piece,
+                       uint_fast8_t p_rotation, trix_point_st p_location )
+{
+  uint_fast8_t              l_row;
+  int_fast8_t               l_left, l_top;
+  const trix_piece_mask_st *l_mask = &p_piece->masks[p_rotation];
+
+  /* Check that we're not off the board. */
+  l_left = p_location.x + l_mask->min_x;
+  l_top = p_location.y + l_mask->min_y;
+  if ( ( l_left < 0 ) || ( p_location.x + l_mask->max_x >= p_core->state.board_width ) ||
+       ( p_location.y + l_mask->max_y >= TRIX_BOARD_HEIGHT ) )
+  {
+    return false;
+  }
+
+  /* Check each row of the piece against the board, but ignore space above. */
+  for( l_row = 0; l_row < l_mask->height; l_row++ )
+  {
+    if ( ( l_top + l_row >= 0 ) &&
+         ( p_core->state.rows[l_top + l_row] & ( l_mask->rows[l_row] << l_left ) ) )
+    {
+      return false;
+    }
+  }
+
+  /* No clashes, so it's a valid move. */
+  return true;
+}
+
+
+/*
+ * landing - works out where a piece would come to rest if dropped straight
+ *           down from the given location. Rather than trying each row in
+ *           turn, the bottom of each column of the piece is compared with
+ *           the surface of the board below it; only when a piece has been
+ *           tucked in under an overhang do we need to look at the rows.
+ */
+
+trix_point_st core_landing( const trix_core_st *p_core, const trix_piece_st *p_piece,
+                            uint_fast8_t p_rotation, trix_point_st p_location )
+{
+  const trix_piece_mask_st *l_mask = &p_piece->masks[p_rotation];
+  uint_fast8_t              l_column;
+  int_fast16_t              l_x, l_bottom, l_below, l_fall = TRIX_BOARD_HEIGHT;
+
+  for ( l_column = 0; l_column <= l_mask->max_x - l_mask->min_x; l_column++ )
+  {
+    /* The lowest block of the piece in this column... */
+    if ( l_mask->bottom[l_column] == INT_FAST8_MIN )
+    {
+      continue;
+    }
+    l_x = p_location.x + l_mask->min_x + l_column;
+    l_bottom = p_location.y + l_mask->bottom[l_column];
+
+    /* ...falls until it meets the surface, or whatever's directly below. */
+    l_below = p_core->state.surface[l_x];
+    if ( l_below <= l_bottom )
+    {
+      for ( l_below = l_bottom + 1;
+            ( l_below < TRIX_BOARD_HEIGHT ) && !( p_core->state.rows[l_below] & ( 1u << l_x ) );
+            l_below++ )
+      {
+        /* Nothing here yet, keep looking. */
+      }
+    }
+
+    /* The piece as a whole only falls as far as its shortest column. */
+    if ( l_below - l_bottom - 1 < l_fall )
+    {
+      l_fall = l_below - l_bottom - 1;
+    }
+  }
+
+  p_location.y += l_fall;
+  return p_location;
+}
+
+
+/*
+ * spawn_location - returns where new pieces appear on the board; top and
+ *                  (roughly) centre.
+ */
+
+trix_point_st core_spawn_location( const trix_core_st *p_core )
+{
+  trix_point_st l_location;
+
+  l_location.x = ( p_core->state.board_width / 2 ) - 1;
+  l_location.y = -1;
+  return l_location;
+}
+
+
+/*
+ * preview - peeks at the next p_count pieces (and the rotations they will
+ *           appear in), without disturbing the game; this works on a copy of
+ *           the game's generator, making exactly the same calls the game
+ *           will when it spawns them. Returns the number of pieces filled in.
+ */
+
+uint_fast8_t core_preview( const trix_core_st *p_core, const trix_piece_st **p_pieces,
+                           uint_fast8_t *p_rotations, uint_fast8_t p_count )
+{
+  trix_rng_st   l_rng = p_core->rng;
+  uint_fast8_t  l_index;
+
+  for ( l_index = 0; l_index < p_count; l_index++ )
+  {
+    p_pieces[l_index] = piece_select( p_core->state.mode, &l_rng );
+    if ( p_pieces[l_index] == NULL )
+    {
+      break;
+    }
+    p_rotations[l_index] = rng_range( &l_rng, 4 );
+  }
+
+  return l_index;
+}
+
+
+/*
+ * state - returns a pointer to our internal gamestate; useful for rendering
+ *         and for post-game work.
+ */
+
+const trix_gamestate_st *core_state( const trix_core_st *p_core )
+{
+  return &p_core->state;
+}
+
+
+/* End of file core.c */
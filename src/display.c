@@ -18,7 +18,6 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <time.h>
-#include <unistd.h>
 #include "SDL.h"
 #include "SDL_image.h"
 
@@ -123,8 +122,9 @@ bool display_init( void )
     return false;
   }
 
-  /* Try to build a renderer for that window. */
-  m_renderer = SDL_CreateRenderer( m_window, -1, 0 );
+  /* Try to build a renderer for that window, synced to the display if asked. */
+  m_renderer = SDL_CreateRenderer( m_window, -1,
+                                   config_get_int( CONF_VSYNC ) ? SDL_RENDERER_PRESENTVSYNC : 0 );
   if ( m_renderer == NULL )
   {
     /* We can't work without a renderer. */
@@ -262,11 +262,42 @@ SDL_Rect *display_scale_rect_to_scale( uint_fast8_t p_x, uint_fast8_t p_y,
 }
 
 
+/*
+ * display_create_layer - creates a texture the size of the whole screen at the
+ *                        current resolution, for an engine to compose all the
+ *                        parts of its screen that never change into. It can
+ *                        then be copied to the screen in one go every frame,
+ *                        instead of clearing it. Returns NULL on failure.
+ */
+
+SDL_Texture *display_create_layer( void )
+{
+  SDL_Texture  *l_layer;
+  int           l_width, l_height;
+
+  /* Work out how big the screen actually is... */
+  if ( SDL_GetRendererOutputSize( m_renderer, &l_width, &l_height ) < 0 )
+  {
+    log_write( ERROR, "SDL_GetRendererOutputSize() failed - %s", SDL_GetError() );
+    return NULL;
+  }
+
+  /* ...and make a texture to match, that we can render into. */
+  l_layer = SDL_CreateTexture( m_renderer, SDL_PIXELFORMAT_RGBA8888,
+                               SDL_TEXTUREACCESS_TARGET, l_width, l_height );
+  if ( l_layer == NULL )
+  {
+    log_write( ERROR, "SDL_CreateTexture() for a layer failed - %s", SDL_GetError() );
+  }
+  return l_layer;
+}
+
+
 /* 
  * display_find_asset - given a bare asset name, determines the appropriate
  *                      PNG file to load for the current resolution - falling
  *                      back to the next highest resolutions as required.
- *                      Filenames are <asset-name>-<scale-factor>.png
+ *                      The files themselves are found in the asset index.
  *                      This function returns the scale factor used, or 0 if
  *                      no suitable file could be identified.
  */
@@ -274,46 +305,29 @@ SDL_Rect *display_scale_rect_to_scale( uint_fast8_t p_x, uint_fast8_t p_y,
 uint_fast8_t display_find_asset( const char *p_asset_name, char *p_file_buffer )
 {
   int_fast8_t   l_index;
-  uint_fast8_t  l_scale;
-  char          l_asset_prefix[TRIX_PATH_MAX+1];
+  const char   *l_filename;
 
-  /* All assets are in the asset path - work out the prefix. */
-  snprintf( l_asset_prefix, sizeof( l_asset_prefix ), "%.100s/%.100s",
-            TRIX_ASSET_PATH, p_asset_name );
-
-  /* And now, work through scales, starting with the present resolution. */
+  /* Work through scales, starting with the present resolution. */
   for ( l_index = m_current_resolution; l_index >= 0; l_index-- )
   {
-    /* Form up the full asset name. */
-    snprintf( p_file_buffer, TRIX_PATH_MAX, "%.200s-%d.png",
-              l_asset_prefix, m_resolutions[l_index].scale );
-
-    /* If it's readable, we have a hit. */
-    if ( access( p_file_buffer, R_OK ) == 0 )
+    l_filename = asset_locate( p_asset_name, m_resolutions[l_index].scale );
+    if ( l_filename != NULL )
     {
-      l_scale = m_resolutions[l_index].scale;
-      break;
+      snprintf( p_file_buffer, TRIX_PATH_MAX, "%s", l_filename );
+      return m_resolutions[l_index].scale;
     }
   }
 
-  /* If we got no match, last effort is the naked asset - fail to blank. */
-  if ( l_index < 0 )
+  /* If we got no match, last effort is the naked asset, which is assumed */
+  /* to be the lowest resolution - fail to blank.                         */
+  l_filename = asset_locate( p_asset_name, 0 );
+  if ( l_filename != NULL )
   {
-    snprintf( p_file_buffer, TRIX_PATH_MAX, "%.200s.png", l_asset_prefix );
-    if ( access( p_file_buffer, R_OK ) == 0 )
-    {
-      /* Naked assets are assumed to be the lowest resolution. */
-      l_scale = m_resolutions[0].scale;
-    }
-    else
-    {
-      p_file_buffer[0] = '\0';
-      l_scale = 0;
-    }
+    snprintf( p_file_buffer, TRIX_PATH_MAX, "%s", l_filename );
+    return m_resolutions[0].scale;
   }
-
-  /* And return the scale factor. */
-  return l_scale;
+  p_file_buffer[0] = '\0';
+  return 0;
 }
 
 /* End of file display.c */
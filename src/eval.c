@@ -0,0 +1,262 @@
+/*
+ * eval.c - part of Tessalatrix
+ *
+ * Board evaluation, for anything that wants to play the game by itself. A
+ * board is scored as a weighted sum of a handful of simple features (how tall
+ * it is, how many holes it has, how bumpy the surface is, how deep its wells
+ * are and how many lines were cleared getting there), and the best placement
+ * for the current piece is simply the one which leaves the best scoring board.
+ *
+ * Copyright (c) 2023 Pete Favelle <ahnlak@ahnlak.com>
+ *
+ * This file is released under the MIT License; see LICENSE for details.
+ */
+
+/* System headers. */
+
+#include <stdint.h>
+#include <string.h>
+
+
+/* Local headers. */
+
+#include "trixcore.h"
+
+
+/*
+ * Static functions; a collection of things only built for use locally.
+ */
+
+/*
+ * count_bits - counts the set bits in a row mask; rows are short enough that
+ *              clearing the lowest bit until there are none left is plenty.
+ */
+
+static uint_fast8_t eval_count_bits( trix_row_t p_row )
+{
+  uint_fast8_t  l_count;
+
+  for ( l_count = 0; p_row != 0; l_count++ )
+  {
+    p_row &= p_row - 1;
+  }
+
+  return l_count;
+}
+
+
+/*
+ * score - weighs up a board from its column heights and hole count; the
+ *         aggregate height, bumpiness and wells all come from the heights,
+ *         a well being a column lower than both its neighbours (or walls).
+ */
+
+static double eval_score( const uint_fast8_t *p_heights, uint_fast8_t p_width,
+                          uint_fast16_t p_holes, uint_fast16_t p_lines,
+                          const trix_weights_st *p_weights )
+{
+  uint_fast8_t  l_column;
+  uint_fast8_t  l_left, l_right;
+  uint_fast16_t l_height = 0, l_bumpiness = 0, l_wells = 0;
+
+  for ( l_column = 0; l_column < p_width; l_column++ )
+  {
+    l_height += p_heights[l_column];
+    if ( l_column > 0 )
+    {
+      l_bumpiness += p_heights[l_column] > p_heights[l_column-1] ?
+                     p_heights[l_column] - p_heights[l_column-1] :
+                     p_heights[l_column-1] - p_heights[l_column];
+    }
+    l_left = l_column > 0 ? p_heights[l_column-1] : TRIX_BOARD_HEIGHT;
+    l_right = l_column < p_width - 1 ? p_heights[l_column+1] : TRIX_BOARD_HEIGHT;
+    if ( ( l_left > p_heights[l_column] ) && ( l_right > p_heights[l_column] ) )
+    {
+      l_wells += ( l_left < l_right ? l_left : l_right ) - p_heights[l_column];
+    }
+  }
+
+  return p_weights->height * l_height + p_weights->holes * p_holes +
+         p_weights->bumpiness * l_bumpiness + p_weights->wells * l_wells +
+         p_weights->lines * p_lines;
+}
+
+
+/* Functions. */
+
+/*
+ * default_weights - fills in a sensible, hand-picked set of weights; good
+ *                   enough to play a convincing game, if not a great one.
+ */
+
+void eval_default_weights( trix_weights_st *p_weights )
+{
+  p_weights->height = -0.510066;
+  p_weights->holes = -0.35663;
+  p_weights->bumpiness = -0.184483;
+  p_weights->wells = 0.0;
+  p_weights->lines = 0.760666;
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * place - drops the piece into a copy of the board rows at the given rotation
+ *         and location, and removes any lines that completes. The resulting
+ *         rows are written to p_result, and the number of lines cleared is
+ *         returned. Blocks above the top of the board vanish, just as they
+ *         do in the game itself.
+ */
+
+uint_fast8_t eval_place( const trix_row_t *p_rows, trix_row_t p_full_row,
+                         const trix_piece_st *p_piece, uint_fast8_t p_rotation,
+                         trix_point_st p_location, trix_row_t *p_result )
+{
+  const trix_piece_mask_st *l_mask = &p_piece->masks[p_rotation];
+  int_fast8_t               l_read, l_write, l_top;
+  uint_fast8_t              l_row, l_cleared = 0;
+
+  /* Merge the piece into a copy of the board. */
+  memcpy( p_result, p_rows, sizeof( trix_row_t ) * TRIX_BOARD_HEIGHT );
+  l_top = p_location.y + l_mask->min_y;
+  for ( l_row = 0; l_row < l_mask->height; l_row++ )
+  {
+    if ( l_top + l_row >= 0 )
+    {
+      p_result[l_top + l_row] |= l_mask->rows[l_row] << ( p_location.x + l_mask->min_x );
+    }
+  }
+
+  /* And compact the board down over any completed lines, bottom up. */
+  for ( l_read = l_write = TRIX_BOARD_HEIGHT - 1; l_read >= 0; l_read-- )
+  {
+    if ( p_result[l_read] == p_full_row )
+    {
+      l_cleared++;
+      continue;
+    }
+    p_result[l_write--] = p_result[l_read];
+  }
+  for ( ; l_write >= 0; l_write-- )
+  {
+    p_result[l_write] = 0;
+  }
+
+  /* Return the number of lines we cleared. */
+  return l_cleared;
+}
+
+
+/*
+ * board - scores a board, given as one mask per row, with the supplied
+ *         weights; higher is better. The features are all gathered in a
+ *         single pass down the rows, tracking which columns have been
+ *         covered by something above.
+ */
+
+double eval_board( const trix_row_t *p_rows, uint_fast8_t p_width,
+                   uint_fast8_t p_lines, const trix_weights_st *p_weights )
+{
+  uint_fast8_t  l_heights[TRIX_BOARD_ROW_MAX];
+  uint_fast8_t  l_row, l_column;
+  uint_fast16_t l_holes = 0;
+  trix_row_t    l_covered = 0, l_new;
+
+  /* Work down the board; the first block in a column sets its height, and */
+  /* every empty cell below a covered column is a hole.                    */
+  memset( l_heights, 0, sizeof( l_heights ) );
+  for ( l_row = 0; l_row < TRIX_BOARD_HEIGHT; l_row++ )
+  {
+    l_holes += eval_count_bits( l_covered & ~p_rows[l_row] );
+    l_new = p_rows[l_row] & ~l_covered;
+    for ( l_column = 0; l_new != 0; l_column++, l_new >>= 1 )
+    {
+      if ( l_new & 1 )
+      {
+        l_heights[l_column] = TRIX_BOARD_HEIGHT - l_row;
+      }
+    }
+    l_covered |= p_rows[l_row];
+  }
+
+  /* The rest comes from the heights. */
+  return eval_score( l_heights, p_width, l_holes, p_lines, p_weights );
+}
+
+
+/*
+ * state - scores the board of a running game, in the same way as board();
+ *         the game keeps its surface and hole count up to date as it goes,
+ *         so there's no need to look at the rows at all. The number of lines
+ *         to credit is up to the caller.
+ */
+
+double eval_state( const trix_gamestate_st *p_state, uint_fast16_t p_lines,
+                   const trix_weights_st *p_weights )
+{
+  uint_fast8_t  l_heights[TRIX_BOARD_ROW_MAX];
+  uint_fast8_t  l_column;
+
+  for ( l_column = 0; l_column < p_state->board_width; l_column++ )
+  {
+    l_heights[l_column] = TRIX_BOARD_HEIGHT - p_state->surface[l_column];
+  }
+
+  return eval_score( l_heights, p_state->board_width, p_state->holes, p_lines, p_weights );
+}
+
+
+/*
+ * choose - picks the best reachable placement for the current piece, using
+ *          the supplied weights. The chosen placement (including the path to
+ *          reach it) is copied into p_choice; returns false if the piece has
+ *          nowhere to go at all. Placements which leave blocks above the top
+ *          of the board lose those blocks, so are penalised by
+ *          TRIX_EVAL_TOPPED_OUT and only ever chosen as a last resort.
+ */
+
+bool eval_choose( const trix_core_st *p_core, const trix_weights_st *p_weights,
+                  trix_placement_st *p_choice )
+{
+  const trix_gamestate_st *l_state = core_state( p_core );
+  trix_placement_st        l_placements[TRIX_MOVES_MAX];
+  trix_row_t               l_rows[TRIX_BOARD_HEIGHT];
+  uint_fast16_t            l_count, l_index, l_best = 0;
+  uint_fast8_t             l_lines;
+  double                   l_score, l_best_score = 0.0;
+
+  /* Find everywhere we could put this piece. */
+  l_count = moves_find( p_core, l_placements, TRIX_MOVES_MAX );
+  if ( l_count == 0 )
+  {
+    return false;
+  }
+
+  /* Score each one in turn, and keep the best. */
+  for ( l_index = 0; l_index < l_count; l_index++ )
+  {
+    l_lines = eval_place( l_state->rows, l_state->full_row, l_state->piece,
+                          l_placements[l_index].rotation, l_placements[l_index].location, l_rows );
+    l_score = eval_board( l_rows, l_state->board_width, l_lines, p_weights );
+    if ( l_placements[l_index].location.y +
+         l_state->piece->masks[l_placements[l_index].rotation].min_y < 0 )
+    {
+      l_score += TRIX_EVAL_TOPPED_OUT;
+    }
+
+    if ( ( l_index == 0 ) || ( l_score > l_best_score ) )
+    {
+      l_best = l_index;
+      l_best_score = l_score;
+    }
+  }
+
+  /* Hand back the winner. */
+  memcpy( p_choice, &l_placements[l_best], sizeof( trix_placement_st ) );
+  return true;
+}
+
+
+/* End of file eval.c */
@@ -12,8 +12,8 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 #include "SDL.h"
-#include "SDL_image.h"
 
 
 /* Local headers. */
@@ -21,24 +21,30 @@
 #include "tessalatrix.h"
 
 
+/* Constants. */
+
+/* A resting piece only wakes us for its next drop; if the limit were  */
+/* that short, any oversleep at all would be skipped as missed time.    */
+#if       TRIX_CATCHUP_MS < 2 * TRIX_BASE_DROP_MS
+#error    "TRIX_CATCHUP_MS must cover at least two gravity drops"
+#endif
+
+
 /* Module variables. */
 
 static SDL_Texture       *m_sprite_texture;
 static uint_fast8_t       m_sprite_scale;
 
-static uint_fast32_t      m_last_move_tick;
-static uint_fast32_t      m_last_drop_tick;
-
-static uint_fast32_t      m_drop_speed;
+static uint_fast32_t      m_last_tick;
 
-static bool               m_dropping;
-static SDL_Keycode        m_current_cmd;
+static trix_repeat_st     m_repeat[INPUT_MAX];
+static uint_fast32_t      m_das_ms;
+static uint_fast32_t      m_arr_ms;
 
-static trix_gamestate_st  m_game_state;
+static bool               m_autoplay;
 
-static trix_piece_st      m_current_piece;
-static SDL_Point          m_current_location;
-static uint_fast8_t       m_current_rotation;
+static trix_core_st       m_core;
+static const trix_gamestate_st *m_game_state;
 
 static SDL_Rect           m_border_bl_src_rect;
 static SDL_Rect           m_border_base_src_rect;
@@ -46,8 +52,9 @@ static SDL_Rect           m_border_br_src_rect;
 static SDL_Rect           m_border_left_src_rect;
 static SDL_Rect           m_border_right_src_rect;
 
-static SDL_Rect           m_border_bl_target_rect;
-static SDL_Rect           m_border_br_target_rect;
+static SDL_Texture       *m_background_texture;
+static bool               m_background_redraw;
+static uint8_t            m_background_cells[TRIX_BOARD_HEIGHT][TRIX_BOARD_WIDTH];
 
 
 /*
@@ -63,14 +70,11 @@ static SDL_Rect           m_border_br_target_rect;
 
 static bool game_load_sprites( void )
 {
-  char          l_sprite_filename[TRIX_PATH_MAX+1];
-
   /* Load up the sprite image (hopefully!) */
-  m_sprite_scale = display_find_asset( TRIX_ASSET_GAME_SPRITES, l_sprite_filename );
-  m_sprite_texture = IMG_LoadTexture( display_get_renderer(), l_sprite_filename );
+  asset_release( m_sprite_texture );
+  m_sprite_texture = asset_acquire( TRIX_ASSET_GAME_SPRITES, &m_sprite_scale );
   if ( m_sprite_texture == NULL )
   {
-    log_write( ERROR, "IMG_LoadTexture of %s failed - %s", TRIX_ASSET_GAME_SPRITES, SDL_GetError() );
     return false;
   }
 
@@ -91,13 +95,19 @@ static bool game_load_sprites( void )
           display_scale_rect_to_scale( 20, 5, 5, 5, m_sprite_scale ), 
           sizeof( SDL_Rect ) );
 
-  /* And work out the target corners of the game board, too. */
-  memcpy( &m_border_bl_target_rect,
-          display_scale_rect_to_screen( 0, 105, 5, 5 ), 
-          sizeof( SDL_Rect ) );  
-  memcpy( &m_border_br_target_rect,
-          display_scale_rect_to_screen( 5 * ( m_game_state.board_width+1 ), 105, 5, 5 ), 
-          sizeof( SDL_Rect ) );  
+  /* Everything that doesn't move (the board's frame, the labels and the */
+  /* settled board itself) is drawn into a layer of its own, at the      */
+  /* current resolution, and only redrawn where the board changes.       */
+  if ( m_background_texture != NULL )
+  {
+    SDL_DestroyTexture( m_background_texture );
+  }
+  m_background_texture = display_create_layer();
+  if ( m_background_texture == NULL )
+  {
+    return false;
+  }
+  m_background_redraw = true;
 
   /* All done! */
   return true;
@@ -105,98 +115,258 @@ static bool game_load_sprites( void )
 
 
 /*
- * init_board - called at the start of a game, to initialise the board ready
- *              to be played. This involves selecting the correct board width
- *              for our game type, and making sure it's empty.
+ * draw_background - brings the background layer up to date with the settled
+ *                   board. Only the cells which have changed since it was
+ *                   last drawn (by a piece locking, or lines clearing) are
+ *                   redrawn, unless the whole thing needs redrawing, frame,
+ *                   labels and all.
  */
 
-static void game_init_board( void )
+static void game_draw_background( void )
 {
-  uint_fast8_t l_row, l_column;
+  uint_fast8_t  l_index;
+  uint_fast8_t  l_row, l_column;
+  uint8_t       l_cell;
+
+  /* If there's nothing to draw into, or nothing has changed, we're done. */
+  if ( ( m_background_texture == NULL ) ||
+       ( ( !m_background_redraw ) &&
+         ( memcmp( m_background_cells, m_game_state->cells, sizeof( m_background_cells ) ) == 0 ) ) )
+  {
+    return;
+  }
+  SDL_SetRenderTarget( display_get_renderer(), m_background_texture );
+  SDL_SetRenderDrawColor( display_get_renderer(), 0, 0, 0, 255 );
+
+  /* A full redraw starts from black, with the labels and the frame around */
+  /* the board.                                                             */
+  if ( m_background_redraw )
+  {
+    SDL_RenderClear( display_get_renderer() );
+    text_draw(  90, 10, "Score:" );
+    text_draw(  90, 17, "Lines:" );
 
-  /* For now, we only understand four-block pieces. */
-  m_game_state.board_width = 10;
+    /* Make sure nobody mistakes the autoplayer for a real game. */
+    if ( m_autoplay )
+    {
+      text_draw(  90, 31, "Demo" );
+      text_draw(  90, 38, "Press any key" );
+    }
+
+    /* Corners first. */
+    SDL_RenderCopy( display_get_renderer(), m_sprite_texture, &m_border_bl_src_rect,
+                    display_scale_rect_to_screen( 0, 105, 5, 5 ) );
+    SDL_RenderCopy( display_get_renderer(), m_sprite_texture, &m_border_br_src_rect,
+                    display_scale_rect_to_screen( 5 * ( m_game_state->board_width+1 ), 105, 5, 5 ) );
+
+    /* And the bottom line next. */
+    for( l_index = 1; l_index <= m_game_state->board_width; l_index++ )
+    {
+      SDL_RenderCopy( display_get_renderer(), m_sprite_texture, &m_border_base_src_rect,
+                      display_scale_rect_to_screen( 5 * l_index, 105, 5, 5 ) );
+    }
 
+    /* Lastly the walls. */
+    for( l_index = 1; l_index <= TRIX_BOARD_HEIGHT; l_index++ )
+    {
+      SDL_RenderCopy( display_get_renderer(), m_sprite_texture, &m_border_left_src_rect,
+                      display_scale_rect_to_screen( 0, 105 - ( 5 * l_index ), 5, 5 ) );
+      SDL_RenderCopy( display_get_renderer(), m_sprite_texture, &m_border_right_src_rect,
+                      display_scale_rect_to_screen( 5 * ( m_game_state->board_width+1 ), 105 - ( 5 * l_index ), 5, 5 ) );
+    }
+  }
+
+  /* Now, run through the board and redraw any cells that have changed. */
   for ( l_row = 0; l_row < TRIX_BOARD_HEIGHT; l_row++ )
   {
-    for ( l_column = 0; l_column < m_game_state.board_width; l_column++ )
+    for ( l_column = 0; l_column < m_game_state->board_width; l_column++ )
     {
-      m_game_state.board[l_column][l_row] = PIECE_NONE;
+      l_cell = m_game_state->cells[l_row][l_column];
+      if ( ( !m_background_redraw ) && ( l_cell == m_background_cells[l_row][l_column] ) )
+      {
+        continue;
+      }
+
+      /* Blank out whatever was there before... */
+      SDL_RenderFillRect( display_get_renderer(),
+                          display_scale_rect_to_screen( 5 + ( 5 * l_column ), 5 + ( 5 * l_row ), 5, 5 ) );
+
+      /* ...and draw the new block; the four-piece blocks are in a simply */
+      /* addressable row.                                                 */
+      if ( ( l_cell > PIECE_4_MIN ) && ( l_cell < PIECE_4_MAX ) )
+      {
+        SDL_RenderCopy( display_get_renderer(), m_sprite_texture, 
+                        display_scale_rect_to_scale( 5 * ( l_cell - PIECE_4_MIN - 1 ), 0, 5, 5, m_sprite_scale ), 
+                        display_scale_rect_to_screen( 5 + ( 5 * l_column ), 5 + ( 5 * l_row ), 5, 5 ) );
+      }
     }
   }
 
-  /* Reset our game parameters. */
-  m_drop_speed = TRIX_BASE_DROP_MS;
-  m_dropping = false;
-  m_game_state.score = m_game_state.lines = 0;
+  /* Remember what we drew, and go back to drawing on the screen. */
+  memcpy( m_background_cells, m_game_state->cells, sizeof( m_background_cells ) );
+  m_background_redraw = false;
+  SDL_SetRenderTarget( display_get_renderer(), NULL );
+
+  /* All done. */
+  return;
 }
 
 
 /*
- * check_space - a simple boolean flag to show if a given piece / rotation /
- *               location can fit onto the game board.
+ * key_input - translates a key into the game input it stands for, if any.
  */
 
-static bool game_check_space( const trix_piece_st *p_piece, uint_fast8_t p_rotation, 
-                              SDL_Point p_location )
+static trix_input_t game_key_input( const SDL_Keysym *p_key )
 {
-  uint_fast8_t  l_index;
-  SDL_Point     l_block_loc;
+  switch( p_key->sym )
+  {
+    case SDLK_COMMA:                                      /* Move left. */
+    case SDLK_LEFT:
+      return INPUT_LEFT;
+    case SDLK_SLASH:                                     /* Move right. */
+    case SDLK_RIGHT:
+      return INPUT_RIGHT;
+    case SDLK_PERIOD:                                        /* Rotate. */
+    case SDLK_UP:
+      return INPUT_ROTATE;
+    case SDLK_SPACE:                                           /* Drop. */
+      return INPUT_DROP;
+    default:
+      return INPUT_NONE;
+  }
+}
 
-  /* Work through all the blocks of the piece. */
-  for( l_index = 0; l_index < p_piece->block_count; l_index++ )
+
+/*
+ * step_to - applies a single input to the game at the given tick, stepping the
+ *           core on to that moment first; the game never goes backwards, so
+ *           anything stamped earlier than the last step is applied then.
+ *           Time is simulated in fixed, millisecond ticks, however often
+ *           we're called; since nothing changes between gravity drops, the
+ *           core is stepped from one drop straight to the next, so the game
+ *           plays out identically whatever the frame rate. If we've been held
+ *           up for too long, the missing time is skipped rather than caught
+ *           up. Returns false once the game is over.
+ */
+
+static bool game_step_to( trix_input_t p_input, uint_fast32_t p_tick )
+{
+  uint_fast32_t l_delta;
+
+  /* Inputs can't be applied before the last thing we did. */
+  if ( (int32_t)( p_tick - m_last_tick ) < 0 )
   {
-    /* Work out the block address. */
-    l_block_loc.x = p_location.x + p_piece->blocks[p_rotation][l_index].x;
-    l_block_loc.y = p_location.y + p_piece->blocks[p_rotation][l_index].y;
+    p_tick = m_last_tick;
+  }
 
-    /* Check that we're not off the board. */
-    if ( ( l_block_loc.y >= TRIX_BOARD_HEIGHT ) ||
-         ( l_block_loc.x < 0 ) || ( l_block_loc.x >= m_game_state.board_width ) )
+  /* Don't try to catch up on more time than the game can sensibly absorb. */
+  if ( p_tick - m_last_tick > TRIX_CATCHUP_MS )
+  {
+    log_write( TRACE, "Skipping %u ms of missed game time",
+               (unsigned int)( p_tick - m_last_tick - TRIX_CATCHUP_MS ) );
+    m_last_tick = p_tick - TRIX_CATCHUP_MS;
+  }
+
+  /* Step the game core on, one gravity drop at a time, up to the tick... */
+  do
+  {
+    l_delta = core_next_drop( &m_core );
+    if ( l_delta > p_tick - m_last_tick )
     {
-      return false;
+      l_delta = p_tick - m_last_tick;
     }
-
-    /* Check to see if the board is occupied, but ignore space above. */
-    if ( ( l_block_loc.y >= 0 ) && ( m_game_state.board[l_block_loc.x][l_block_loc.y] != PIECE_NONE ) )
+    if ( !core_step( &m_core, INPUT_NONE, l_delta ) )
     {
       return false;
     }
+    m_last_tick += l_delta;
+  } while ( m_last_tick != p_tick );
+
+  /* ...and only then apply the input itself. */
+  if ( ( p_input != INPUT_NONE ) && ( !core_step( &m_core, p_input, 0 ) ) )
+  {
+    return false;
   }
 
-  /* No clashes, so it's a valid move. */
+  /* With instant repeat, a fully charged direction keeps the piece pinned */
+  /* against whatever is in the way, including any newly spawned piece.   */
+  if ( ( m_repeat[INPUT_LEFT].charged ) && ( !core_step( &m_core, INPUT_SHIFT_LEFT, 0 ) ) )
+  {
+    return false;
+  }
+  if ( ( m_repeat[INPUT_RIGHT].charged ) && ( !core_step( &m_core, INPUT_SHIFT_RIGHT, 0 ) ) )
+  {
+    return false;
+  }
+
+  /* And make sure we're woken up when gravity next wants to move things. */
+  sched_at( TIMER_GRAVITY, m_last_tick + core_next_drop( &m_core ) );
+
+  /* The game goes on. */
   return true;
 }
 
 
 /*
- * copy_to_board - adds the specified piece to the game board, if possible.
+ * repeat_to - applies every auto-repeat of a held key that falls due up to the
+ *             given tick, each at the moment it falls due. Once a key has been
+ *             held for the delay, it repeats every m_arr_ms; if that is zero,
+ *             the key is instead charged, and the piece simply goes as far as
+ *             it can. Returns false once the game is over.
  */
 
-static bool game_copy_to_board( const trix_piece_st *p_piece, uint_fast8_t p_rotation, 
-                                SDL_Point p_location )
+static bool game_repeat_to( uint_fast32_t p_tick )
 {
-  uint_fast8_t  l_index;
-  SDL_Point     l_block_loc;
+  trix_input_t  l_input, l_next;
+  uint_fast32_t l_tick;
 
-  /* Sanity check that we can do this. */
-  if ( !game_check_space( p_piece, p_rotation, p_location ) )
+  while ( true )
   {
-    return false;
+    /* Find whichever held key is next due to repeat, if any are by now. */
+    l_next = INPUT_NONE;
+    for ( l_input = INPUT_LEFT; l_input <= INPUT_RIGHT; l_input++ )
+    {
+      if ( ( m_repeat[l_input].held ) && ( !m_repeat[l_input].charged ) &&
+           ( (int32_t)( m_repeat[l_input].next_tick - p_tick ) <= 0 ) &&
+           ( ( l_next == INPUT_NONE ) ||
+             ( (int32_t)( m_repeat[l_input].next_tick - m_repeat[l_next].next_tick ) < 0 ) ) )
+      {
+        l_next = l_input;
+      }
+    }
+    if ( l_next == INPUT_NONE )
+    {
+      break;
+    }
+
+    /* And repeat it, at the moment it was due. */
+    l_tick = m_repeat[l_next].next_tick;
+    if ( m_arr_ms == 0 )
+    {
+      m_repeat[l_next].charged = true;
+      l_next = INPUT_NONE;
+    }
+    else
+    {
+      m_repeat[l_next].next_tick += m_arr_ms;
+    }
+    if ( !game_step_to( l_next, l_tick ) )
+    {
+      return false;
+    }
   }
 
-  /* Good; should be a simple process then. */
-  for( l_index = 0; l_index < p_piece->block_count; l_index++ )
+  /* Make sure we're woken up for the next repeat, if there will be one. */
+  sched_cancel( TIMER_REPEAT );
+  for ( l_input = INPUT_LEFT; l_input <= INPUT_RIGHT; l_input++ )
   {
-    /* Work out the block address. */
-    l_block_loc.x = p_location.x + p_piece->blocks[p_rotation][l_index].x;
-    l_block_loc.y = p_location.y + p_piece->blocks[p_rotation][l_index].y;
-
-    /* And add it to the board. */
-    m_game_state.board[l_block_loc.x][l_block_loc.y] = p_piece->piece;
+    if ( ( m_repeat[l_input].held ) && ( !m_repeat[l_input].charged ) )
+    {
+      sched_at( TIMER_REPEAT, m_repeat[l_input].next_tick );
+    }
   }
 
-  /* All good then! */
+  /* The game goes on. */
   return true;
 }
 
@@ -209,8 +379,8 @@ static bool game_copy_to_board( const trix_piece_st *p_piece, uint_fast8_t p_rot
 
 void game_init( void )
 {
-  /* Initialise the board, suitable for the current game mode. */
-  game_init_board();
+  /* Start a fresh game in the core. */
+  game_restart();
 
   /* Load up the sprite image (hopefully!) */
   if ( !game_load_sprites() )
@@ -218,11 +388,15 @@ void game_init( void )
     log_write( ERROR, "Failed to load game sprites" );
   }
 
-  /* Clear any current command. */
-  m_current_cmd = SDLK_UNKNOWN;
+  /* And make sure the end of the game is ready for us. */
+  asset_prefetch( TRIX_ASSET_OVER_SPRITES );
 
-  /* Remember what tick we were initialised at. */
-  m_last_drop_tick = m_last_move_tick = SDL_GetTicks();
+  /* Games are played by people, unless the autoplayer says otherwise. */
+  m_autoplay = false;
+
+  /* Work out how held keys should repeat. */
+  m_das_ms = config_get_int( CONF_DAS ) > 0 ? config_get_int( CONF_DAS ) : 0;
+  m_arr_ms = config_get_int( CONF_ARR ) > 0 ? config_get_int( CONF_ARR ) : 0;
 
   /* All done. */
   return;
@@ -237,12 +411,12 @@ void game_init( void )
 
 void game_event( const SDL_Event *p_event )
 {
-  /* If it's a keypress, set the current command to this; yes, if the user */
-  /* presses multiple keys in the same frame, we may drop some. So, maybe  */
-  /* don't do that?!                                                       */
-  if ( p_event->type == SDL_KEYDOWN )
+  /* Input reaches us through the queue; but if the renderer loses the */
+  /* contents of our background layer, it will need drawing again.     */
+  if ( ( p_event->type == SDL_RENDER_TARGETS_RESET ) ||
+       ( p_event->type == SDL_RENDER_DEVICE_RESET ) )
   {
-    m_current_cmd = p_event->key.keysym.sym;
+    m_background_redraw = true;
   }
 
   /* All done. */
@@ -257,152 +431,64 @@ void game_event( const SDL_Event *p_event )
 
 trix_engine_t game_update( void )
 {
-  uint_fast8_t  l_index, l_column, l_row;
-  bool          l_line_complete;
-  uint_fast32_t l_current_tick = SDL_GetTicks();
-  uint_fast8_t  l_new_rotation;
-  SDL_Point     l_new_location;
-
-  /* Process any queued key command. */
-  switch( m_current_cmd )
-  {
-    case SDLK_COMMA:                                      /* Move left. */
-    case SDLK_LEFT:
-      /* Only attempt the move every TRIX_MOVE_MS milliseconds. */
-      if ( l_current_tick > ( m_last_move_tick + TRIX_MOVE_MS ) )
-      {
-        /* Work out the new position. */
-        l_new_location.x = m_current_location.x - 1;
-        l_new_location.y = m_current_location.y;
-
-        /* Check that we'll fit. */
-        if ( game_check_space( &m_current_piece, m_current_rotation, l_new_location ) )
-        {
-          m_current_location.x = l_new_location.x;
-          m_last_move_tick = l_current_tick;
-        }
-      }
-      break;
-    case SDLK_SLASH:                                     /* Move right. */
-    case SDLK_RIGHT:
-      /* Only attempt the move every TRIX_MOVE_MS milliseconds. */
-      if ( l_current_tick > ( m_last_move_tick + TRIX_MOVE_MS ) )
-      {
-        /* Work out the new position. */
-        l_new_location.x = m_current_location.x + 1;
-        l_new_location.y = m_current_location.y;
-
-        /* Check that we'll fit. */
-        if ( game_check_space( &m_current_piece, m_current_rotation, l_new_location ) )
-        {
-          m_current_location.x = l_new_location.x;
-          m_last_move_tick = l_current_tick;
-        }
-      }
-      break;
-    case SDLK_PERIOD:                                        /* Rotate. */
-    case SDLK_UP:
-      /* Only attempt the move every TRIX_MOVE_MS milliseconds. */
-      if ( l_current_tick > ( m_last_move_tick + TRIX_MOVE_MS ) )
-      {
-        /* Work out the new position. */
-        l_new_rotation = m_current_rotation >= 3 ? 0 : m_current_rotation+1;
-
-        /* Check that we'll fit. */
-        if ( game_check_space( &m_current_piece, l_new_rotation, m_current_location ) )
-        {
-          m_current_rotation = l_new_rotation;
-          m_last_move_tick = l_current_tick;
-        }
-      }
-      break;
-
-    case SDLK_SPACE:                                           /* Drop. */
-      m_dropping = true;
-      break;
-  }
+  trix_queued_st  l_queued;
+  trix_input_t    l_input, l_opposite;
 
-  /* Clear any current command, for the next input. */
-  m_current_cmd = SDLK_UNKNOWN;
-
-  /* If it's time to drop the current piece another line, do so. */
-  if ( ( l_current_tick >= ( m_last_drop_tick + m_drop_speed ) ) ||
-       ( ( m_dropping ) && ( l_current_tick >= ( m_last_drop_tick + TRIX_FALL_MS ) ) ) )
+  /* Work through any queued keypresses, applying each to the game at the */
+  /* moment it actually happened, in the order they happened. The keys'   */
+  /* own repeats are ignored; we do our own, from when keys went down.    */
+  while ( input_pop( &l_queued ) )
   {
-    /* Fairly simple, increment the Y axis and check it worked. */
-    l_new_location.x = m_current_location.x;
-    l_new_location.y = m_current_location.y + 1;
+    if ( ( ( l_queued.type != QUEUED_KEY_DOWN ) && ( l_queued.type != QUEUED_KEY_UP ) ) ||
+         ( l_queued.repeat ) ||
+         ( ( l_input = game_key_input( &l_queued.key ) ) == INPUT_NONE ) )
+    {
+      continue;
+    }
 
-    /* Check that we'll fit. */
-    if ( game_check_space( &m_current_piece, m_current_rotation, l_new_location ) )
+    /* Anything held that was due to repeat before this happened, does. */
+    if ( !game_repeat_to( l_queued.timestamp ) )
     {
-      m_current_location.y = l_new_location.y;
-      m_last_drop_tick = l_current_tick;
+      return ENGINE_OVER;
     }
-    else
+
+    /* Releasing a key just stops it repeating. */
+    if ( l_queued.type == QUEUED_KEY_UP )
     {
-      /* It doesn't fit, so transfer it to the board, and spawn a fresh piece. */
-      game_copy_to_board( &m_current_piece, m_current_rotation, m_current_location );
-      m_game_state.score += m_current_piece.value;
-      m_current_piece.piece = PIECE_NONE;
+      m_repeat[l_input].held = m_repeat[l_input].charged = false;
+      continue;
+    }
 
-      /* This is probably a good time to check for any completed lines. */
-      for ( l_row = TRIX_BOARD_HEIGHT - 1; l_row > 0; l_row-- )
-      {
-        /* Look for any empty blocks in the line. */
-        l_line_complete = true;
-        for ( l_column = 0; l_column < m_game_state.board_width; l_column++ )
-        {
-          if ( m_game_state.board[l_column][l_row] == PIECE_NONE )
-          {
-            l_line_complete = false;
-            break;
-          }
-        }
-
-        /* If that line is complete, blank it and drop everything above it down. */
-        if ( l_line_complete )
-        {
-          /* Go over every line. */
-          for ( l_index = l_row; l_index > 0; l_index-- )
-          {
-            for ( l_column = 0; l_column < m_game_state.board_width; l_column++ )
-            {
-              m_game_state.board[l_column][l_index] = m_game_state.board[l_column][l_index-1];
-            }
-          }
-
-          /* Blank the top row. */
-          for ( l_column = 0; l_column < m_game_state.board_width; l_column++ )
-          {
-            m_game_state.board[l_column][0] = PIECE_NONE;
-          }
-
-          /* And check the newly dropped line. */
-          m_game_state.lines++;
-          m_game_state.score += 10;
-          l_row++;
-        }
-      }
+    /* Sideways moves repeat once held for long enough; the most recent */
+    /* direction pressed takes over from the other.                    */
+    if ( ( l_input == INPUT_LEFT ) || ( l_input == INPUT_RIGHT ) )
+    {
+      l_opposite = l_input == INPUT_LEFT ? INPUT_RIGHT : INPUT_LEFT;
+      m_repeat[l_opposite].held = m_repeat[l_opposite].charged = false;
+      m_repeat[l_input].held = true;
+      m_repeat[l_input].charged = false;
+      m_repeat[l_input].next_tick = l_queued.timestamp + m_das_ms;
     }
-  }
 
-  /* If we don't have a current piece, we should probably pick one. */
-  if ( m_current_piece.piece == PIECE_NONE )
-  {
-    memcpy( &m_current_piece, piece_select( GAME_MODE_STANDARD ), sizeof( trix_piece_st ) );
-    m_current_location.x = ( m_game_state.board_width / 2 ) - 1;
-    m_current_location.y = -1;
-    m_current_rotation = rand() % 4;
-    m_dropping = false;
-
-    /* Now check to see if that fit; if it didn't, the game is over. */
-    if ( !game_check_space( &m_current_piece, m_current_rotation, m_current_location ) )
+    /* And apply it to the game. */
+    if ( !game_step_to( l_input, l_queued.timestamp ) )
     {
       return ENGINE_OVER;
     }
   }
 
+  /* Then bring the game, and any held keys, up to date. */
+  if ( ( !game_repeat_to( SDL_GetTicks() ) ) || ( !game_step( INPUT_NONE ) ) )
+  {
+    return ENGINE_OVER;
+  }
+
+  /* While the piece is falling, keep the frames coming to animate it. */
+  if ( m_game_state->landing.y != m_game_state->location.y )
+  {
+    sched_at( TIMER_ANIMATION, m_last_tick + TRIX_FPS_MS );
+  }
+
   /* By default, ask to stay in our current engine. */
   return ENGINE_GAME;
 }
@@ -416,77 +502,69 @@ trix_engine_t game_update( void )
 void game_render( void )
 {
   uint_fast8_t  l_index;
-  uint_fast8_t  l_row, l_column;
+  uint_fast32_t l_elapsed;
+  int           l_fall_offset = 0;
   SDL_Rect      l_source_block, l_target_block;
 
-  /* Clear to black. */
-  SDL_SetRenderDrawColor( display_get_renderer(), 0, 0, 0, 255 );
-  SDL_RenderClear( display_get_renderer() );
-
-  /* Draw the board frame - corners first. */
-  SDL_RenderCopy( display_get_renderer(), m_sprite_texture, &m_border_bl_src_rect, &m_border_bl_target_rect );
-  SDL_RenderCopy( display_get_renderer(), m_sprite_texture, &m_border_br_src_rect, &m_border_br_target_rect );
+  /* Bring the settled board up to date, before drawing on the screen. */
+  game_draw_background();
 
-  /* And the bottom line next. */
-  for( l_index = 1; l_index <= m_game_state.board_width; l_index++ )
-  {
-    SDL_RenderCopy( display_get_renderer(), m_sprite_texture, &m_border_base_src_rect,
-                    display_scale_rect_to_screen( 5 * l_index, 105, 5, 5 ) );
-  }
+  /* Everything that doesn't move then comes ready drawn. */
+  SDL_RenderCopy( display_get_renderer(), m_background_texture, NULL, NULL );
 
-  /* Lastly the walls. */
-  for( l_index = 1; l_index <= TRIX_BOARD_HEIGHT; l_index++ )
+  /* Draw the current piece into it's board location. */
+  if ( m_game_state->piece != NULL )
   {
-    SDL_RenderCopy( display_get_renderer(), m_sprite_texture, &m_border_left_src_rect,
-                    display_scale_rect_to_screen( 0, 105 - ( 5 * l_index ), 5, 5 ) );
-    SDL_RenderCopy( display_get_renderer(), m_sprite_texture, &m_border_right_src_rect,
-                    display_scale_rect_to_screen( 5 * ( m_game_state.board_width+1 ), 105 - ( 5 * l_index ), 5, 5 ) );
-  }
+    /* We'll use the same rect for all the blocks of the same piece. */
 
-  /* Now, run through the board and render any blocks. */
-  for ( l_row = 0; l_row < TRIX_BOARD_HEIGHT; l_row++ )
-  {
-    for ( l_column = 0; l_column < m_game_state.board_width; l_column++ )
+    /* All the four-piece blocks are in a simply addressable row. */
+    if ( ( m_game_state->piece->piece > PIECE_4_MIN ) && 
+         ( m_game_state->piece->piece < PIECE_4_MAX ) )
     {
-      /* Precalculate the destination rectangle. */
-      memcpy( &l_target_block, 
-              display_scale_rect_to_screen( 5 + ( 5 * l_column ), 5 + ( 5 * l_row ), 5, 5 ),
+      memcpy( &l_source_block,
+              display_scale_rect_to_scale( 5 * ( m_game_state->piece->piece - PIECE_4_MIN - 1 ), 
+                                           0, 5, 5, m_sprite_scale ),
               sizeof( SDL_Rect ) );
+    }
 
-      /* All the four-piece blocks are in a simply addressable row. */
-      if ( ( m_game_state.board[l_column][l_row] > PIECE_4_MIN ) && 
-           ( m_game_state.board[l_column][l_row] < PIECE_4_MAX ) )
+    /* The ghost shows where it would land, faintly, if it's not already. */
+    if ( m_game_state->landing.y != m_game_state->location.y )
+    {
+      SDL_SetTextureAlphaMod( m_sprite_texture, TRIX_GHOST_ALPHA );
+      for( l_index = 0; l_index < m_game_state->piece->block_count; l_index++ )
       {
+        memcpy( &l_target_block, 
+                display_scale_rect_to_screen( 5 + ( 5 * (m_game_state->landing.x+m_game_state->piece->blocks[m_game_state->rotation][l_index].x) ), 
+                                              5 + ( 5 * (m_game_state->landing.y+m_game_state->piece->blocks[m_game_state->rotation][l_index].y) ),
+                                              5, 5 ),
+                sizeof( SDL_Rect ) );
+
         SDL_RenderCopy( display_get_renderer(), m_sprite_texture, 
-                        display_scale_rect_to_scale( 5 * ( m_game_state.board[l_column][l_row] - PIECE_4_MIN - 1 ), 0, 5, 5, m_sprite_scale ), 
-                        &l_target_block );
+                        &l_source_block, &l_target_block );
       }
+      SDL_SetTextureAlphaMod( m_sprite_texture, 255 );
     }
-  }
 
-  /* Draw the current piece into it's board location. */
-  if ( m_current_piece.piece != PIECE_NONE )
-  {
-    /* We'll use the same rect for all the blocks of the same piece. */
-
-    /* All the four-piece blocks are in a simply addressable row. */
-    if ( ( m_current_piece.piece > PIECE_4_MIN ) && 
-         ( m_current_piece.piece < PIECE_4_MAX ) )
+    /* If it's still falling, it's drawn part way to the next row, according */
+    /* to how far through the drop we are, so that it falls smoothly.        */
+    if ( m_game_state->landing.y != m_game_state->location.y )
     {
-      memcpy( &l_source_block,
-              display_scale_rect_to_scale( 5 * ( m_current_piece.piece - PIECE_4_MIN - 1 ), 
-                                           0, 5, 5, m_sprite_scale ),
-              sizeof( SDL_Rect ) );
+      l_elapsed = m_core.drop_speed - core_next_drop( &m_core ) + ( SDL_GetTicks() - m_last_tick );
+      if ( l_elapsed < m_core.drop_speed )
+      {
+        l_fall_offset = display_scale_rect_to_screen( 0, 0, 5, 5 )->h * l_elapsed / m_core.drop_speed;
+      }
     }
 
     /* Work through the defined blocks on the current rotation. */
-    for( l_index = 0; l_index < m_current_piece.block_count; l_index++ )
+    for( l_index = 0; l_index < m_game_state->piece->block_count; l_index++ )
     {
       memcpy( &l_target_block, 
-              display_scale_rect_to_screen( 5 + ( 5 * (m_current_location.x+m_current_piece.blocks[m_current_rotation][l_index].x) ), 
-                                            5 + ( 5 * (m_current_location.y+m_current_piece.blocks[m_current_rotation][l_index].y) ),
+              display_scale_rect_to_screen( 5 + ( 5 * (m_game_state->location.x+m_game_state->piece->blocks[m_game_state->rotation][l_index].x) ), 
+                                            5 + ( 5 * (m_game_state->location.y+m_game_state->piece->blocks[m_game_state->rotation][l_index].y) ),
                                             5, 5 ),
               sizeof( SDL_Rect ) );
+      l_target_block.y += l_fall_offset;
 
       SDL_RenderCopy( display_get_renderer(), m_sprite_texture, 
                       &l_source_block, &l_target_block );
@@ -494,10 +572,8 @@ void game_render( void )
   }
 
   /* Scores next; shown to the right of the board. */
-  text_draw(  90, 10, "Score:" );
-  text_draw( 120, 10, "%05d", m_game_state.score );
-  text_draw(  90, 17, "Lines:" );
-  text_draw( 120, 17, "%d", m_game_state.lines );
+  text_draw_number( 120, 10, m_game_state->score, 5 );
+  text_draw_number( 120, 17, m_game_state->lines, 0 );
 
   /* Finally, render the metrics count. */
   metrics_render();
@@ -519,9 +595,47 @@ void game_fini( void )
   /* Release any loaded textures. */
   if ( m_sprite_texture != NULL )
   {
-    SDL_DestroyTexture( m_sprite_texture );
+    asset_release( m_sprite_texture );
     m_sprite_texture = NULL;
   }
+  if ( m_background_texture != NULL )
+  {
+    SDL_DestroyTexture( m_background_texture );
+    m_background_texture = NULL;
+  }
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * restart - starts a fresh game in the core, suitable for the current game
+ *           mode, without touching anything else about the engine.
+ */
+
+void game_restart( void )
+{
+  uint64_t  l_seed;
+
+  /* Use any configured seed, otherwise something suitably unpredictable. */
+  l_seed = (uint32_t)config_get_int( CONF_SEED );
+  if ( l_seed == 0 )
+  {
+    l_seed = ( (uint64_t)time( NULL ) << 32 ) ^ SDL_GetPerformanceCounter();
+  }
+  log_write( LOG, "Starting game with seed %llu", (unsigned long long)l_seed );
+
+  /* Start a fresh game in the core. */
+  core_init( &m_core, GAME_MODE_STANDARD, l_seed );
+  m_game_state = core_state( &m_core );
+
+  /* A new game needs a freshly drawn background. */
+  m_background_redraw = true;
+
+  /* Remember what tick we started at, with no keys held. */
+  m_last_tick = SDL_GetTicks();
+  memset( m_repeat, 0, sizeof( m_repeat ) );
 
   /* All done. */
   return;
@@ -529,13 +643,49 @@ void game_fini( void )
 
 
 /*
- * state - returns a pointer to our internal gamestate; useful for post-game
+ * step - applies a single input to the game, and steps the core on by however
+ *        long it's been since the last step. Human and autoplayer inputs both
+ *        come through here. Returns false once the game is over.
+ */
+
+bool game_step( trix_input_t p_input )
+{
+  return game_step_to( p_input, SDL_GetTicks() );
+}
+
+
+/*
+ * autoplay - flags that the game is being played by the autoplayer, rather
+ *            than a person; this only changes what is rendered.
+ */
+
+void game_autoplay( bool p_autoplay )
+{
+  m_autoplay = p_autoplay;
+  m_background_redraw = true;
+  return;
+}
+
+
+/*
+ * core - returns a pointer to the game core itself, for anything which needs
+ *        to plan moves against it.
+ */
+
+const trix_core_st *game_core( void )
+{
+  return &m_core;
+}
+
+
+/*
+ * state - returns a pointer to the core's gamestate; useful for post-game
  *         work.
  */
 
 const trix_gamestate_st *game_state( void )
 {
-  return &m_game_state;
+  return m_game_state;
 }
 
 
@@ -13,7 +13,6 @@
 
 #include <stdio.h>
 #include "SDL.h"
-#include "SDL_image.h"
 
 
 /* Local headers. */
@@ -29,6 +28,9 @@ static SDL_Texture   *m_sprite_texture;
 static uint_fast32_t  m_start_tick;
 static SDL_Rect       m_target_rect;
 static SDL_Rect       m_button_deco_rect;
+static SDL_Rect       m_button_src_rect;
+static SDL_Texture   *m_background_texture;
+static bool           m_background_redraw;
 static bool           m_button_active;
 static SDL_Keycode    m_current_cmd;
 static SDL_Point      m_mouse_location;
@@ -37,6 +39,128 @@ static bool           m_mouse_clicked;
 
 static const trix_hiscore_st *m_table;
 
+
+/*
+ * Static functions; a collection of things only built for use locally.
+ */
+
+/*
+ * handle_input - deals with a single input from the queue, exactly as if it
+ *                were the only thing that had happened this frame.
+ */
+
+static trix_engine_t hstable_handle_input( const trix_queued_st *p_queued )
+{
+  /* Take the input into the current command, or the mouse state. */
+  switch( p_queued->type )
+  {
+    case QUEUED_KEY_DOWN:
+      m_current_cmd = p_queued->key.sym;
+      break;
+    case QUEUED_MOTION:
+      m_mouse_moved = true;
+      m_mouse_location = p_queued->point;
+      break;
+    case QUEUED_CLICK:
+      m_mouse_clicked = true;
+      m_mouse_location = p_queued->point;
+      break;
+    default:
+      break;
+  }
+
+  /* Handle any mouse movements. */
+  if ( m_mouse_moved || m_mouse_clicked )
+  {
+    /* See if it's over the button */
+    if ( SDL_PointInRect( &m_mouse_location, &m_button_deco_rect ) )
+    {
+      /* Select the option. */
+      m_button_active = true;
+
+      /* And if we've clicked, select that option too. */
+      if ( m_mouse_clicked )
+      {
+        m_current_cmd = SDLK_RETURN;
+      }
+    }
+    else
+    {
+      m_button_active = false;
+    }
+
+    /* And clear the mouse flags. */
+    m_mouse_moved = m_mouse_clicked = false;
+  }
+
+  /* Process the current command. */
+  switch( m_current_cmd )
+  {
+    case SDLK_UP:                                             /* Move up. */
+    case SDLK_DOWN:                                         /* Move down. */
+      /* This simply activates the main menu buttton if it's not. */
+      m_button_active = true;
+      break;
+    case SDLK_RETURN:            /* If the button is active, activate it! */
+      if ( m_button_active )
+      {
+        return ENGINE_MENU;
+      }
+      break;
+  }
+
+  /* Clear any current command, for the next input. */
+  m_current_cmd = SDLK_UNKNOWN;
+
+  /* Stay in our present engine. */
+  return ENGINE_HSTABLE;
+}
+
+
+/*
+ * draw_background - composes everything that doesn't change (the frame, and
+ *                   the table itself) into our background layer.
+ */
+
+static void hstable_draw_background( void )
+{
+  uint_fast8_t  l_index;
+
+  /* Draw into the layer, rather than the screen. */
+  SDL_SetRenderTarget( display_get_renderer(), m_background_texture );
+
+  /* Clear to black. */
+  SDL_SetRenderDrawColor( display_get_renderer(), 0, 0, 0, 255 );
+  SDL_RenderClear( display_get_renderer() );
+
+  /* Render the frame in which we'll draw the table. */
+  SDL_RenderCopy( display_get_renderer(), m_sprite_texture, NULL, &m_target_rect );
+
+  /* Now build the currency displaying table. */
+  for ( l_index = 0; l_index < TRIX_HISCORE_COUNT; l_index++ )
+  {
+    text_draw(  20, 20 + ( l_index * 7 ), m_table[l_index].name );
+    if ( m_table[l_index].score > 0 )
+    {
+      text_draw_to( 102, 20 + ( l_index * 7 ), "%5d", m_table[l_index].score );
+      text_draw_to( 137, 20 + ( l_index * 7 ), "%4d", m_table[l_index].lines );
+    }
+    else
+    {
+      text_draw_to( 102, 20 + ( l_index * 7 ), "--" );
+      text_draw_to( 137, 20 + ( l_index * 7 ), "-" );
+    }      
+  }
+
+  /* And go back to drawing on the screen. */
+  SDL_SetRenderTarget( display_get_renderer(), NULL );
+  m_background_redraw = false;
+
+  /* All done. */
+  return;
+}
+
+
 /* Functions. */
 
 /*
@@ -45,27 +169,28 @@ static const trix_hiscore_st *m_table;
 
 void hstable_init( void )
 {
-  char          l_sprite_filename[TRIX_PATH_MAX+1];
   uint_fast8_t  l_scale;
 
   /* Load up the our spritesheet */
-  l_scale = display_find_asset( TRIX_ASSET_HST_SPRITES, l_sprite_filename );
-  m_sprite_texture = IMG_LoadTexture( display_get_renderer(), l_sprite_filename );
-  if ( m_sprite_texture == NULL )
-  {
-    log_write( ERROR, "IMG_LoadTexture of %s failed - %s", TRIX_ASSET_HST_SPRITES, SDL_GetError() );
-  }
+  m_sprite_texture = asset_acquire( TRIX_ASSET_HST_SPRITES, &l_scale );
+  asset_prefetch( TRIX_ASSET_MENU_SPRITES );
 
   /* Work out the appropriately scaled target rectangle for this. */
   memcpy( &m_target_rect, 
           display_scale_rect_to_screen( 0, 0, 160, 110 ),
           sizeof( SDL_Rect ) );
 
-  /* And the button deco. */
+  /* And the button deco, along with the part of the frame that covers it. */
   memcpy( &m_button_deco_rect,
           display_scale_rect_to_screen( 50, 91, 60, 11 ), sizeof( SDL_Rect ) );
+  memcpy( &m_button_src_rect,
+          display_scale_rect_to_scale( 50, 91, 60, 11, l_scale ), sizeof( SDL_Rect ) );
   m_button_active = true;
 
+  /* The frame and table are composed once, into a layer of their own. */
+  m_background_texture = display_create_layer();
+  m_background_redraw = true;
+
   /* Clear any current command. */
   m_current_cmd = SDLK_UNKNOWN;
   m_mouse_moved = false;
@@ -89,24 +214,12 @@ void hstable_init( void )
 
 void hstable_event( const SDL_Event *p_event )
 {
-  /* If it's a keypress, set the current command to this; yes, if the user */
-  /* presses multiple keys in the same frame, we may drop some. So, maybe  */
-  /* don't do that?!                                                       */
-  if ( p_event->type == SDL_KEYDOWN )
+  /* Input reaches us through the queue; but if the renderer loses the */
+  /* contents of our background layer, it will need drawing again.     */
+  if ( ( p_event->type == SDL_RENDER_TARGETS_RESET ) ||
+       ( p_event->type == SDL_RENDER_DEVICE_RESET ) )
   {
-    m_current_cmd = p_event->key.keysym.sym;
-  }
-
-  /* If the mouse has moved, flag the movement and remember the location. */
-  if ( p_event->type == SDL_MOUSEMOTION )
-  {
-    m_mouse_moved = true;
-    m_mouse_location.x = p_event->motion.x;
-    m_mouse_location.y = p_event->motion.y;
-  }
-  if ( p_event->type == SDL_MOUSEBUTTONDOWN )
-  {
-    m_mouse_clicked = true;
+    m_background_redraw = true;
   }
 
   /* All done. */
@@ -121,7 +234,9 @@ void hstable_event( const SDL_Event *p_event )
 
 trix_engine_t hstable_update( void )
 {
-  uint_fast32_t l_current_tick = SDL_GetTicks();
+  trix_queued_st  l_queued;
+  trix_engine_t   l_target_engine;
+  uint_fast32_t   l_current_tick = SDL_GetTicks();
 
   /* Blink the cursor on the menu. */
   if ( l_current_tick >= ( m_blink_tick + TRIX_MOVE_MS ) )
@@ -129,50 +244,18 @@ trix_engine_t hstable_update( void )
     m_button_blink = !m_button_blink;
     m_blink_tick = l_current_tick;
   }
+  sched_at( TIMER_BLINK, m_blink_tick + TRIX_MOVE_MS );
 
-  /* Handle any mouse movements. */
-  if ( m_mouse_moved || m_mouse_clicked )
+  /* Work through any queued input, in the order it happened. */
+  while ( input_pop( &l_queued ) )
   {
-    /* See if it's over the button */
-    if ( SDL_PointInRect( &m_mouse_location, &m_button_deco_rect ) )
+    l_target_engine = hstable_handle_input( &l_queued );
+    if ( l_target_engine != ENGINE_HSTABLE )
     {
-      /* Select the option. */
-      m_button_active = true;
-
-      /* And if we've clicked, select that option too. */
-      if ( m_mouse_clicked )
-      {
-        m_current_cmd = SDLK_RETURN;
-      }
+      return l_target_engine;
     }
-    else
-    {
-      m_button_active = false;
-    }
-
-    /* And clear the mouse flags. */
-    m_mouse_moved = m_mouse_clicked = false;
-  }
-
-  /* Process the current command. */
-  switch( m_current_cmd )
-  {
-    case SDLK_UP:                                             /* Move up. */
-    case SDLK_DOWN:                                         /* Move down. */
-      /* This simply activates the main menu buttton if it's not. */
-      m_button_active = true;
-      break;
-    case SDLK_RETURN:            /* If the button is active, activate it! */
-      if ( m_button_active )
-      {
-        return ENGINE_MENU;
-      }
-      break;
   }
 
-  /* Clear any current command, for the next input. */
-  m_current_cmd = SDLK_UNKNOWN;
-
   /* Stay in our present engine. */
   return ENGINE_HSTABLE;
 }
@@ -185,13 +268,15 @@ trix_engine_t hstable_update( void )
 
 void hstable_render( void )
 {
-  uint_fast8_t  l_index;
-
-  /* Clear to black. */
-  SDL_SetRenderDrawColor( display_get_renderer(), 0, 0, 0, 255 );
-  SDL_RenderClear( display_get_renderer() );
+  /* Start from the frame and table, composed when they last changed. */
+  if ( ( m_background_texture != NULL ) && ( m_background_redraw ) )
+  {
+    hstable_draw_background();
+  }
+  SDL_RenderCopy( display_get_renderer(), m_background_texture, NULL, NULL );
 
-  /* Fill in the button halo, if required. */
+  /* Fill in the button halo, if required; it sits behind the frame, so the */
+  /* part of the frame over the button goes back on top of it.              */
   if ( m_button_active )
   {
     if ( m_button_blink )
@@ -203,25 +288,8 @@ void hstable_render( void )
       SDL_SetRenderDrawColor( display_get_renderer(), 255, 252, 64, 255 );    
     }
     SDL_RenderFillRect( display_get_renderer(), &m_button_deco_rect );  
-  }
-
-  /* Render the frame in which we'll draw the table. */
-  SDL_RenderCopy( display_get_renderer(), m_sprite_texture, NULL, &m_target_rect );
-
-  /* Now build the currency displaying table. */
-  for ( l_index = 0; l_index < TRIX_HISCORE_COUNT; l_index++ )
-  {
-    text_draw(  20, 20 + ( l_index * 7 ), m_table[l_index].name );
-    if ( m_table[l_index].score > 0 )
-    {
-      text_draw_to( 102, 20 + ( l_index * 7 ), "%5d", m_table[l_index].score );
-      text_draw_to( 137, 20 + ( l_index * 7 ), "%4d", m_table[l_index].lines );
-    }
-    else
-    {
-      text_draw_to( 102, 20 + ( l_index * 7 ), "--" );
-      text_draw_to( 137, 20 + ( l_index * 7 ), "-" );
-    }      
+    SDL_RenderCopy( display_get_renderer(), m_sprite_texture,
+                    &m_button_src_rect, &m_button_deco_rect );
   }
 
   /* Finally, render the metrics count. */
@@ -244,9 +312,14 @@ void hstable_fini( void )
   /* Release any loaded textures. */
   if ( m_sprite_texture != NULL )
   {
-    SDL_DestroyTexture( m_sprite_texture );
+    asset_release( m_sprite_texture );
     m_sprite_texture = NULL;
   }
+  if ( m_background_texture != NULL )
+  {
+    SDL_DestroyTexture( m_background_texture );
+    m_background_texture = NULL;
+  }
   
   /* All done. */
   return;
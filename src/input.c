@@ -0,0 +1,146 @@
+/*
+ * input.c - part of Tessalatrix
+ *
+ * The input queue; every keypress, key release, mouse movement and click is
+ * queued up here (along with SDL's timestamp of when it happened) as it
+ * arrives, and engines work through the queue in order during their update.
+ * That way, nothing is lost however many inputs arrive within a frame. The
+ * queue is a ring buffer with a single producer and a single consumer, so
+ * needs nothing more than atomic head and tail counters to stay consistent.
+ *
+ * Copyright (c) 2023 Pete Favelle <ahnlak@ahnlak.com>
+ *
+ * This file is released under the MIT License; see LICENSE for details.
+ */
+
+/* System headers. */
+
+#include <stdio.h>
+#include "SDL.h"
+
+
+/* Local headers. */
+
+#include "tessalatrix.h"
+
+
+/* Constants. */
+
+#define   TRIX_INPUT_QUEUE_MASK   ( TRIX_INPUT_QUEUE_SIZE - 1 )
+
+#if       TRIX_INPUT_QUEUE_SIZE & TRIX_INPUT_QUEUE_MASK
+#error    "TRIX_INPUT_QUEUE_SIZE must be a power of two"
+#endif
+
+
+/* Module variables. */
+
+static trix_queued_st m_queue[TRIX_INPUT_QUEUE_SIZE];
+static SDL_atomic_t   m_head;
+static SDL_atomic_t   m_tail;
+static bool           m_overflowed;
+
+
+/* Functions. */
+
+/*
+ * push - adds an SDL event to the back of the queue, if it's one we're
+ *        interested in. Returns false if it wasn't, or there was no room.
+ *        Mouse motion following unread motion just updates that entry,
+ *        as only where the mouse ended up matters; that way a flurry of
+ *        movement can never fill the queue and crowd out keypresses.
+ */
+
+bool input_push( const SDL_Event *p_event )
+{
+  uint32_t        l_head = SDL_AtomicGet( &m_head );
+  uint32_t        l_tail = SDL_AtomicGet( &m_tail );
+  trix_queued_st *l_queued = &m_queue[l_head & TRIX_INPUT_QUEUE_MASK];
+  trix_queued_st *l_newest = &m_queue[(l_head-1) & TRIX_INPUT_QUEUE_MASK];
+
+  /* Motion can be merged into the newest entry, if it's unread motion. */
+  if ( ( p_event->type == SDL_MOUSEMOTION ) && ( l_head != l_tail ) &&
+       ( l_newest->type == QUEUED_MOTION ) )
+  {
+    l_newest->point.x = p_event->motion.x;
+    l_newest->point.y = p_event->motion.y;
+    l_newest->timestamp = p_event->common.timestamp;
+    return true;
+  }
+
+  /* Make sure there's room; if not, something has stopped reading it. */
+  if ( l_head - l_tail >= TRIX_INPUT_QUEUE_SIZE )
+  {
+    if ( !m_overflowed )
+    {
+      log_write( WARN, "Input queue full, dropping input" );
+      m_overflowed = true;
+    }
+    return false;
+  }
+
+  /* Fill in the slot, according to what sort of event this is. */
+  switch( p_event->type )
+  {
+    case SDL_KEYDOWN:
+    case SDL_KEYUP:
+      l_queued->type = p_event->type == SDL_KEYDOWN ? QUEUED_KEY_DOWN : QUEUED_KEY_UP;
+      l_queued->key = p_event->key.keysym;
+      l_queued->repeat = p_event->key.repeat != 0;
+      break;
+    case SDL_MOUSEMOTION:
+      l_queued->type = QUEUED_MOTION;
+      l_queued->point.x = p_event->motion.x;
+      l_queued->point.y = p_event->motion.y;
+      break;
+    case SDL_MOUSEBUTTONDOWN:
+      l_queued->type = QUEUED_CLICK;
+      l_queued->point.x = p_event->button.x;
+      l_queued->point.y = p_event->button.y;
+      break;
+    default:
+      return false;
+  }
+  l_queued->timestamp = p_event->common.timestamp;
+
+  /* Only now that it's complete can the slot be handed over. */
+  SDL_AtomicSet( &m_head, l_head + 1 );
+  m_overflowed = false;
+  return true;
+}
+
+
+/*
+ * pop - takes the oldest input from the front of the queue, copying it into
+ *       p_queued; returns false if the queue is empty.
+ */
+
+bool input_pop( trix_queued_st *p_queued )
+{
+  uint32_t  l_tail = SDL_AtomicGet( &m_tail );
+  uint32_t  l_head = SDL_AtomicGet( &m_head );
+
+  /* Hand back whatever's at the front, if anything. */
+  if ( l_tail == l_head )
+  {
+    return false;
+  }
+  memcpy( p_queued, &m_queue[l_tail & TRIX_INPUT_QUEUE_MASK], sizeof( trix_queued_st ) );
+  SDL_AtomicSet( &m_tail, l_tail + 1 );
+  return true;
+}
+
+
+/*
+ * flush - throws away anything left in the queue; whatever an engine hasn't
+ *         dealt with by the end of its update is of no interest to anyone.
+ */
+
+void input_flush( void )
+{
+  SDL_AtomicSet( &m_tail, SDL_AtomicGet( &m_head ) );
+  return;
+}
+
+
+/* End of file input.c */
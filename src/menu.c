@@ -13,7 +13,6 @@
 
 #include <stdio.h>
 #include "SDL.h"
-#include "SDL_image.h"
 
 
 /* Local headers. */
@@ -26,6 +25,7 @@
 static SDL_Texture   *m_sprite_texture;
 static uint_fast32_t  m_blink_tick;
 static uint_fast32_t  m_last_move_tick;
+static uint_fast32_t  m_idle_tick;
 static SDL_Rect       m_sprite_rect_title;
 static SDL_Rect       m_target_rect_title;
 static SDL_Rect       m_sprite_menu_rect[TRIX_MENU_ENTRIES];
@@ -33,6 +33,8 @@ static SDL_Rect       m_target_menu_rect[TRIX_MENU_ENTRIES];
 static SDL_Rect       m_target_menu_deco_rect[TRIX_MENU_ENTRIES];
 static bool           m_menu_blink;
 static bool           m_option_enabled[TRIX_MENU_ENTRIES];
+static SDL_Texture   *m_background_texture;
+static bool           m_background_redraw;
 
 static SDL_Keycode    m_current_cmd;
 static SDL_Point      m_mouse_location;
@@ -55,15 +57,13 @@ static uint_fast8_t   m_current_option;
 
 static bool menu_load_sprites( void )
 {
-  char          l_sprite_filename[TRIX_PATH_MAX+1];
   uint_fast8_t  l_sprite_scale;
 
   /* Load up the sprite image (hopefully!) */
-  l_sprite_scale = display_find_asset( TRIX_ASSET_MENU_SPRITES, l_sprite_filename );
-  m_sprite_texture = IMG_LoadTexture( display_get_renderer(), l_sprite_filename );
+  asset_release( m_sprite_texture );
+  m_sprite_texture = asset_acquire( TRIX_ASSET_MENU_SPRITES, &l_sprite_scale );
   if ( m_sprite_texture == NULL )
   {
-    log_write( ERROR, "IMG_LoadTexture of %s failed - %s", TRIX_ASSET_MENU_SPRITES, SDL_GetError() );
     return false;
   }
 
@@ -113,41 +113,41 @@ static bool menu_load_sprites( void )
   memcpy( &m_target_menu_deco_rect[4],
           display_scale_rect_to_screen( 50, 89, 60, 12 ), sizeof( SDL_Rect ) );
 
+  /* The title and menu entries are composed into a layer of their own, at */
+  /* the current resolution.                                               */
+  if ( m_background_texture != NULL )
+  {
+    SDL_DestroyTexture( m_background_texture );
+  }
+  m_background_texture = display_create_layer();
+  if ( m_background_texture == NULL )
+  {
+    return false;
+  }
+  m_background_redraw = true;
+
   /* All done! */
   return true;
 }
 
 
-/* Functions. */
-
 /*
- * init - called when the engine is activated, to do any one-time initialising.
+ * draw_entry - draws a single menu entry; disabled ones are drawn faded.
  */
 
-void menu_init( void )
+static void menu_draw_entry( uint_fast8_t p_index )
 {
-  uint_fast8_t l_index;
-
-  /* Load up the sprite image (hopefully!) */
-  if ( !menu_load_sprites() )
+  /* For disabled options, just drop the alpha. */
+  if ( !m_option_enabled[p_index] )
   {
-    log_write( ERROR, "Failed to load menu sprites" );
+    SDL_SetTextureAlphaMod( m_sprite_texture, 150 );
   }
-
-  /* Clear any current command. */
-  m_current_cmd = SDLK_UNKNOWN;
-  m_current_option = 0;
-  m_mouse_moved = false;
-
-  for ( l_index = 0; l_index < TRIX_MENU_ENTRIES; l_index++ )
+  SDL_RenderCopy( display_get_renderer(), m_sprite_texture,
+                  &m_sprite_menu_rect[p_index], &m_target_menu_rect[p_index] );
+  if ( !m_option_enabled[p_index] )
   {
-    m_option_enabled[l_index] = true;
+    SDL_SetTextureAlphaMod( m_sprite_texture, 255 );
   }
-  m_option_enabled[1] = false;
-  m_option_enabled[3] = false;
-
-  /* Remember what tick we were initialised at. */
-  m_blink_tick = m_last_move_tick = SDL_GetTicks();
 
   /* All done. */
   return;
@@ -155,54 +155,66 @@ void menu_init( void )
 
 
 /*
- * event - called for every SDL event received; it's up to the engine what
- *         to do with them, but effects should be queued and handled within
- *         the update.
+ * draw_background - composes everything that doesn't change (the title and
+ *                   all the menu entries) into our background layer.
  */
 
-void menu_event( const SDL_Event *p_event )
+static void menu_draw_background( void )
 {
-  /* If it's a keypress, set the current command to this; yes, if the user */
-  /* presses multiple keys in the same frame, we may drop some. So, maybe  */
-  /* don't do that?!                                                       */
-  if ( p_event->type == SDL_KEYDOWN )
-  {
-    m_current_cmd = p_event->key.keysym.sym;
-  }
+  uint_fast8_t  l_index;
 
-  /* If the mouse has moved, flag the movement and remember the location. */
-  if ( p_event->type == SDL_MOUSEMOTION )
-  {
-    m_mouse_moved = true;
-    m_mouse_location.x = p_event->motion.x;
-    m_mouse_location.y = p_event->motion.y;
-  }
-  if ( p_event->type == SDL_MOUSEBUTTONDOWN )
+  /* Draw into the layer, rather than the screen. */
+  SDL_SetRenderTarget( display_get_renderer(), m_background_texture );
+
+  /* Clear to black. */
+  SDL_SetRenderDrawColor( display_get_renderer(), 0, 0, 0, 255 );
+  SDL_RenderClear( display_get_renderer() );
+
+  /* Draw the title, centered, top of the screen. */
+  SDL_RenderCopy( display_get_renderer(), m_sprite_texture, 
+                  &m_sprite_rect_title, &m_target_rect_title );
+
+  /* Work through all the menu entries themselves. */
+  for ( l_index = 0; l_index < TRIX_MENU_ENTRIES; l_index++ )
   {
-    m_mouse_clicked = true;
+    menu_draw_entry( l_index );
   }
 
+  /* And go back to drawing on the screen. */
+  SDL_SetRenderTarget( display_get_renderer(), NULL );
+  m_background_redraw = false;
+
   /* All done. */
   return;
 }
 
 
 /*
- * update - update the internal state of the engine; this is also where we
- *          handle and process any user input, but no drawing is done here.
+ * handle_input - deals with a single input from the queue, exactly as if it
+ *                were the only thing that had happened this frame.
  */
 
-trix_engine_t menu_update( void )
+static trix_engine_t menu_handle_input( const trix_queued_st *p_queued )
 {
   uint_fast8_t  l_index;
   int_fast8_t   l_new_option;
-  uint_fast32_t l_current_tick = SDL_GetTicks();
 
-  /* Blink the cursor on the menu. */
-  if ( l_current_tick >= ( m_blink_tick + TRIX_MOVE_MS ) )
+  /* Take the input into the current command, or the mouse state. */
+  switch( p_queued->type )
   {
-    m_menu_blink = !m_menu_blink;
-    m_blink_tick = l_current_tick;
+    case QUEUED_KEY_DOWN:
+      m_current_cmd = p_queued->key.sym;
+      break;
+    case QUEUED_MOTION:
+      m_mouse_moved = true;
+      m_mouse_location = p_queued->point;
+      break;
+    case QUEUED_CLICK:
+      m_mouse_clicked = true;
+      m_mouse_location = p_queued->point;
+      break;
+    default:
+      break;
   }
 
   /* Handle any mouse movements. */
@@ -236,7 +248,7 @@ trix_engine_t menu_update( void )
   {
     case SDLK_UP:                                             /* Move up. */
       /* Only attempt the move every TRIX_MOVE_MS milliseconds. */
-      if ( l_current_tick > ( m_last_move_tick + TRIX_MOVE_MS ) )
+      if ( p_queued->timestamp > ( m_last_move_tick + TRIX_MOVE_MS ) )
       {
         /* Move around the menu. */
         if ( m_current_option > 0 ) 
@@ -255,12 +267,12 @@ trix_engine_t menu_update( void )
             m_current_option = l_new_option;
           }
         }
-        m_last_move_tick = l_current_tick;
+        m_last_move_tick = p_queued->timestamp;
       }
       break;
     case SDLK_DOWN:                                         /* Move down. */
       /* Only attempt the move every TRIX_MOVE_MS milliseconds. */
-      if ( l_current_tick > ( m_last_move_tick + TRIX_MOVE_MS ) )
+      if ( p_queued->timestamp > ( m_last_move_tick + TRIX_MOVE_MS ) )
       {
         /* Move around the menu. */
         if ( m_current_option < TRIX_MENU_ENTRIES-1 ) 
@@ -279,7 +291,7 @@ trix_engine_t menu_update( void )
             m_current_option = l_new_option;
           }
         }
-        m_last_move_tick = l_current_tick;
+        m_last_move_tick = p_queued->timestamp;
       }
       break;
     case SDLK_RETURN:         /* Activate the currently selection option. */
@@ -306,6 +318,116 @@ trix_engine_t menu_update( void )
 }
 
 
+/* Functions. */
+
+/*
+ * init - called when the engine is activated, to do any one-time initialising.
+ */
+
+void menu_init( void )
+{
+  uint_fast8_t l_index;
+
+  /* Load up the sprite image (hopefully!) */
+  if ( !menu_load_sprites() )
+  {
+    log_write( ERROR, "Failed to load menu sprites" );
+  }
+
+  /* And make sure wherever we go next is ready for us. */
+  asset_prefetch( TRIX_ASSET_GAME_SPRITES );
+  asset_prefetch( TRIX_ASSET_HST_SPRITES );
+
+  /* Clear any current command. */
+  m_current_cmd = SDLK_UNKNOWN;
+  m_current_option = 0;
+  m_mouse_moved = false;
+
+  for ( l_index = 0; l_index < TRIX_MENU_ENTRIES; l_index++ )
+  {
+    m_option_enabled[l_index] = true;
+  }
+  m_option_enabled[1] = false;
+  m_option_enabled[3] = false;
+
+  /* Remember what tick we were initialised at. */
+  m_blink_tick = m_last_move_tick = m_idle_tick = SDL_GetTicks();
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * event - called for every SDL event received; it's up to the engine what
+ *         to do with them, but effects should be queued and handled within
+ *         the update.
+ */
+
+void menu_event( const SDL_Event *p_event )
+{
+  /* Any sign of life from the user keeps the attract mode at bay; the input */
+  /* itself reaches us through the queue.                                    */
+  if ( ( p_event->type == SDL_KEYDOWN ) || ( p_event->type == SDL_MOUSEMOTION ) ||
+       ( p_event->type == SDL_MOUSEBUTTONDOWN ) )
+  {
+    m_idle_tick = SDL_GetTicks();
+  }
+
+  /* If the renderer loses the contents of our background layer, it will */
+  /* need drawing again.                                                 */
+  if ( ( p_event->type == SDL_RENDER_TARGETS_RESET ) ||
+       ( p_event->type == SDL_RENDER_DEVICE_RESET ) )
+  {
+    m_background_redraw = true;
+  }
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * update - update the internal state of the engine; this is also where we
+ *          handle and process any user input, but no drawing is done here.
+ */
+
+trix_engine_t menu_update( void )
+{
+  trix_queued_st  l_queued;
+  trix_engine_t   l_target_engine;
+  uint_fast32_t   l_current_tick = SDL_GetTicks();
+
+  /* Blink the cursor on the menu. */
+  if ( l_current_tick >= ( m_blink_tick + TRIX_MOVE_MS ) )
+  {
+    m_menu_blink = !m_menu_blink;
+    m_blink_tick = l_current_tick;
+  }
+  sched_at( TIMER_BLINK, m_blink_tick + TRIX_MOVE_MS );
+
+  /* If nobody has touched anything for a while, let the autoplayer loose. */
+  if ( l_current_tick >= ( m_idle_tick + TRIX_ATTRACT_MS ) )
+  {
+    return ENGINE_AI;
+  }
+  sched_at( TIMER_IDLE, m_idle_tick + TRIX_ATTRACT_MS );
+
+  /* Work through any queued input, in the order it happened. */
+  while ( input_pop( &l_queued ) )
+  {
+    l_target_engine = menu_handle_input( &l_queued );
+    if ( l_target_engine != ENGINE_MENU )
+    {
+      return l_target_engine;
+    }
+  }
+
+  /* Stay in our present engine. */
+  return ENGINE_MENU;
+}
+
+
 /*
  * render - draws the internal state of the engine onto the screen; no logic
  *          should be here, it's all the presentational stuff.
@@ -313,17 +435,15 @@ trix_engine_t menu_update( void )
 
 void menu_render( void )
 {
-  uint_fast8_t  l_index;
-
-  /* Clear to black. */
-  SDL_SetRenderDrawColor( display_get_renderer(), 0, 0, 0, 255 );
-  SDL_RenderClear( display_get_renderer() );
-
-  /* Draw the title, centered, top of the screen. */
-  SDL_RenderCopy( display_get_renderer(), m_sprite_texture, 
-                  &m_sprite_rect_title, &m_target_rect_title );
+  /* Start from the title and entries, composed when they last changed. */
+  if ( ( m_background_texture != NULL ) && ( m_background_redraw ) )
+  {
+    menu_draw_background();
+  }
+  SDL_RenderCopy( display_get_renderer(), m_background_texture, NULL, NULL );
 
-  /* Now a nice glowy box around the currently selected menu item. */
+  /* Now a nice glowy box around the currently selected menu item, which */
+  /* then needs drawing again on top of it.                              */
   if ( m_menu_blink )
   {
     SDL_SetRenderDrawColor( display_get_renderer(), 255, 213, 65, 255 );
@@ -333,22 +453,7 @@ void menu_render( void )
     SDL_SetRenderDrawColor( display_get_renderer(), 255, 252, 64, 255 );    
   }
   SDL_RenderFillRect( display_get_renderer(), &m_target_menu_deco_rect[m_current_option] );
-
-  /* Work through all the menu entries themselves. */
-  for ( l_index = 0; l_index < TRIX_MENU_ENTRIES; l_index++ )
-  {
-    /* For disabled options, just drop the alpha. */
-    if ( !m_option_enabled[l_index] )
-    {
-      SDL_SetTextureAlphaMod( m_sprite_texture, 150 );
-    }
-    SDL_RenderCopy( display_get_renderer(), m_sprite_texture,
-                    &m_sprite_menu_rect[l_index], &m_target_menu_rect[l_index] );
-    if ( !m_option_enabled[l_index] )
-    {
-      SDL_SetTextureAlphaMod( m_sprite_texture, 255 );
-    }
-  }
+  menu_draw_entry( m_current_option );
 
   /* Finally, render the metrics count. */
   metrics_render();
@@ -370,9 +475,14 @@ void menu_fini( void )
   /* Release any loaded textures. */
   if ( m_sprite_texture != NULL )
   {
-    SDL_DestroyTexture( m_sprite_texture );
+    asset_release( m_sprite_texture );
     m_sprite_texture = NULL;
   }
+  if ( m_background_texture != NULL )
+  {
+    SDL_DestroyTexture( m_background_texture );
+    m_background_texture = NULL;
+  }
 
   /* All done. */
   return;
@@ -15,7 +15,6 @@
 #include <stdio.h>
 #include <time.h>
 #include "SDL.h"
-#include "SDL_image.h"
 
 
 /* Local headers. */
@@ -29,11 +28,15 @@ static bool           m_active = false;
 static time_t         m_current_second;
 static uint_fast8_t   m_current_frames;
 static uint_fast8_t   m_last_fps;
+static uint_fast32_t  m_current_missed;
+static uint_fast32_t  m_last_missed;
 static SDL_Texture   *m_sprite_texture = NULL;
 static SDL_Rect       m_fps_frame_src_rect;
 static SDL_Rect       m_fps_frame_target_rect;
 static SDL_Rect       m_fps_digit_src_rect[10];
 static SDL_Rect       m_fps_digit_target_rect[2];
+static SDL_Rect       m_missed_frame_target_rect;
+static SDL_Rect       m_missed_digit_target_rect[2];
 
 
 /* Functions. */
@@ -45,18 +48,15 @@ static SDL_Rect       m_fps_digit_target_rect[2];
 
 void metrics_enable( void )
 {
-  char          l_sprite_filename[TRIX_PATH_MAX+1];
   uint_fast8_t  l_sprite_scale;
   uint_fast8_t  l_index;
 
   /* Load up the sprite image if we don't already have it. */
   if ( m_sprite_texture == NULL )
   {
-    l_sprite_scale = display_find_asset( TRIX_ASSET_METRICS_SPRITES, l_sprite_filename );
-    m_sprite_texture = IMG_LoadTexture( display_get_renderer(), l_sprite_filename );
+    m_sprite_texture = asset_acquire( TRIX_ASSET_METRICS_SPRITES, &l_sprite_scale );
     if ( m_sprite_texture == NULL )
     {
-      log_write( ERROR, "IMG_LoadTexture of %s failed - %s", TRIX_ASSET_METRICS_SPRITES, SDL_GetError() );
       return;
     }
 
@@ -82,6 +82,15 @@ void metrics_enable( void )
   memcpy( &m_fps_digit_target_rect[1],
           display_scale_rect_to_screen( 6, 104, 4, 4 ),
           sizeof( SDL_Rect ) );
+  memcpy( &m_missed_frame_target_rect,
+          display_scale_rect_to_screen( 12, 102, 12, 8 ),
+          sizeof( SDL_Rect ) );
+  memcpy( &m_missed_digit_target_rect[0],
+          display_scale_rect_to_screen( 14, 104, 4, 4 ),
+          sizeof( SDL_Rect ) );
+  memcpy( &m_missed_digit_target_rect[1],
+          display_scale_rect_to_screen( 18, 104, 4, 4 ),
+          sizeof( SDL_Rect ) );
 
   /* And lastly, flag ourselves as active. */
   m_active = true;
@@ -147,6 +156,14 @@ void metrics_update( void )
     m_current_second = l_this_second;
     m_last_fps = m_current_frames;
     m_current_frames = 0;
+
+    /* Missed frame deadlines are counted up by the second, too. */
+    if ( m_current_missed > 0 )
+    {
+      log_write( TRACE, "Missed %u frame deadlines", (unsigned int)m_current_missed );
+    }
+    m_last_missed = m_current_missed;
+    m_current_missed = 0;
   }
 
   /* And then just increment our fps counter. */
@@ -157,6 +174,18 @@ void metrics_update( void )
 }
 
 
+/*
+ * missed - called by the frame pacer whenever frames go out late, with the
+ *          number of frame deadlines that were missed.
+ */
+
+void metrics_missed( uint_fast32_t p_count )
+{
+  m_current_missed += p_count;
+  return;
+}
+
+
 /*
  * render - draws the current fps in the corner of the screen; should be the
  *          last thing called by an engine's renderer, ideally.
@@ -164,6 +193,8 @@ void metrics_update( void )
 
 void metrics_render( void )
 {
+  uint_fast32_t l_missed;
+
   /* If we're not active, jump out immediately. */
   if ( !m_active )
   {
@@ -180,6 +211,18 @@ void metrics_render( void )
   SDL_RenderCopy( display_get_renderer(), m_sprite_texture, 
                   &m_fps_digit_src_rect[m_last_fps%10], &m_fps_digit_target_rect[1] );
 
+  /* Alongside it, any frame deadlines missed in that second (up to 99). */
+  if ( m_last_missed > 0 )
+  {
+    l_missed = m_last_missed > 99 ? 99 : m_last_missed;
+    SDL_RenderCopy( display_get_renderer(), m_sprite_texture, 
+                    &m_fps_frame_src_rect, &m_missed_frame_target_rect );
+    SDL_RenderCopy( display_get_renderer(), m_sprite_texture, 
+                    &m_fps_digit_src_rect[l_missed/10], &m_missed_digit_target_rect[0] );
+    SDL_RenderCopy( display_get_renderer(), m_sprite_texture, 
+                    &m_fps_digit_src_rect[l_missed%10], &m_missed_digit_target_rect[1] );
+  }
+
   /* All done. */
   return;
 }
@@ -0,0 +1,242 @@
+/*
+ * moves.c - part of Tessalatrix
+ *
+ * The move generator; finds every final resting place the current piece can
+ * reach from where it is now, using only the moves the game itself allows
+ * (left, right, rotate and gravity), along with the inputs needed to get
+ * there. This is the starting point for anything that wants to play or
+ * analyse the game.
+ *
+ * Copyright (c) 2023 Pete Favelle <ahnlak@ahnlak.com>
+ *
+ * This file is released under the MIT License; see LICENSE for details.
+ */
+
+/* System headers. */
+
+#include <stdint.h>
+#include <string.h>
+
+
+/* Local headers. */
+
+#include "trixcore.h"
+
+
+/* Constants. */
+
+#define   TRIX_MOVES_X_OFFSET   4
+#define   TRIX_MOVES_X_RANGE    ( TRIX_BOARD_ROW_MAX + 2 * TRIX_MOVES_X_OFFSET )
+#define   TRIX_MOVES_Y_OFFSET   4
+#define   TRIX_MOVES_Y_RANGE    ( TRIX_BOARD_HEIGHT + TRIX_MOVES_Y_OFFSET + 1 )
+#define   TRIX_MOVES_NODES      ( 4 * TRIX_MOVES_X_RANGE * TRIX_MOVES_Y_RANGE )
+#define   TRIX_MOVES_NO_PARENT  UINT16_MAX
+
+
+/*
+ * Static functions; a collection of things only built for use locally.
+ */
+
+/*
+ * node - works out the search node index for a given rotation and location;
+ *        rotations are folded onto their alias, so that symmetric rotations
+ *        share a node, and the location can be recovered from the index.
+ *        Returns TRIX_MOVES_NODES if it's off the search grid.
+ */
+
+static uint_fast16_t moves_node( const trix_piece_st *p_piece, uint_fast8_t p_rotation,
+                                 trix_point_st p_location )
+{
+  int_fast16_t  l_x = p_location.x + TRIX_MOVES_X_OFFSET;
+  int_fast16_t  l_y = p_location.y + TRIX_MOVES_Y_OFFSET;
+
+  if ( ( l_x < 0 ) || ( l_x >= TRIX_MOVES_X_RANGE ) ||
+       ( l_y < 0 ) || ( l_y >= TRIX_MOVES_Y_RANGE ) )
+  {
+    return TRIX_MOVES_NODES;
+  }
+
+  return ( p_piece->alias[p_rotation] * TRIX_MOVES_X_RANGE + l_x ) * TRIX_MOVES_Y_RANGE + l_y;
+}
+
+
+/* Functions. */
+
+/*
+ * find - a breadth first search over every position the current piece can
+ *        reach, recording each one where gravity can take it no further. At
+ *        most p_max placements are written into p_placements, each with the
+ *        shortest input path to reach it; INPUT_NONE in a path stands for
+ *        letting gravity drop the piece a row. Symmetric rotations are only
+ *        ever reported once. Returns the number of placements found.
+ */
+
+uint_fast16_t moves_find( const trix_core_st *p_core, trix_placement_st *p_placements,
+                          uint_fast16_t p_max )
+{
+  static const trix_input_t l_moves[] = { INPUT_LEFT, INPUT_RIGHT, INPUT_ROTATE, INPUT_NONE };
+  const trix_gamestate_st  *l_state = core_state( p_core );
+  const trix_piece_st      *l_piece = l_state->piece;
+  uint16_t                  l_parent[TRIX_MOVES_NODES];
+  uint8_t                   l_move[TRIX_MOVES_NODES];
+  uint8_t                   l_rotation[TRIX_MOVES_NODES];
+  uint16_t                  l_queue[TRIX_MOVES_NODES];
+  uint_fast16_t             l_head, l_tail, l_node, l_next, l_step;
+  uint_fast16_t             l_found = 0;
+  uint_fast8_t              l_index, l_length, l_new_rotation;
+  trix_point_st             l_location, l_new_location;
+  bool                      l_resting;
+
+  /* No piece, nowhere to go. */
+  if ( ( l_piece == NULL ) ||
+       ( !core_check_space( p_core, l_piece, l_state->rotation, l_state->location ) ) )
+  {
+    return 0;
+  }
+
+  /* Start the search from wherever the piece is now. */
+  memset( l_parent, 0xFF, sizeof( l_parent ) );
+  l_node = moves_node( l_piece, l_state->rotation, l_state->location );
+  if ( l_node >= TRIX_MOVES_NODES )
+  {
+    return 0;
+  }
+  l_rotation[l_node] = l_state->rotation;
+  l_parent[l_node] = l_node;
+  l_queue[0] = l_node;
+  l_head = 0;
+  l_tail = 1;
+
+  /* Work through the queue, trying every move from every position. */
+  while ( l_head < l_tail )
+  {
+    l_node = l_queue[l_head++];
+    l_location.x = (int_fast16_t)( ( l_node / TRIX_MOVES_Y_RANGE ) % TRIX_MOVES_X_RANGE ) - TRIX_MOVES_X_OFFSET;
+    l_location.y = (int_fast16_t)( l_node % TRIX_MOVES_Y_RANGE ) - TRIX_MOVES_Y_OFFSET;
+    l_resting = false;
+
+    for ( l_index = 0; l_index < sizeof( l_moves ) / sizeof( l_moves[0] ); l_index++ )
+    {
+      /* Work out where this move would take us. */
+      l_new_rotation = l_rotation[l_node];
+      l_new_location = l_location;
+      switch( l_moves[l_index] )
+      {
+        case INPUT_LEFT:
+          l_new_location.x--;
+          break;
+        case INPUT_RIGHT:
+          l_new_location.x++;
+          break;
+        case INPUT_ROTATE:
+          l_new_rotation = l_new_rotation >= 3 ? 0 : l_new_rotation+1;
+          break;
+        default:
+          l_new_location.y++;
+          break;
+      }
+
+      /* If it doesn't fit, there's nothing more to do; unless it was */
+      /* gravity that was blocked, in which case this is a placement.  */
+      if ( !core_check_space( p_core, l_piece, l_new_rotation, l_new_location ) )
+      {
+        if ( l_moves[l_index] == INPUT_NONE )
+        {
+          l_resting = true;
+        }
+        continue;
+      }
+
+      /* Queue it up, if it's somewhere we've not already been. */
+      l_next = moves_node( l_piece, l_new_rotation, l_new_location );
+      if ( ( l_next < TRIX_MOVES_NODES ) && ( l_parent[l_next] == TRIX_MOVES_NO_PARENT ) )
+      {
+        l_parent[l_next] = l_node;
+        l_move[l_next] = l_moves[l_index];
+        l_rotation[l_next] = l_new_rotation;
+        l_queue[l_tail++] = l_next;
+      }
+    }
+
+    /* Resting positions become placements, if there's room for them. */
+    if ( ( !l_resting ) || ( l_found >= p_max ) )
+    {
+      continue;
+    }
+
+    /* Count the path length first, then fill it in backwards. */
+    for ( l_length = 0, l_step = l_node; l_parent[l_step] != l_step; l_step = l_parent[l_step] )
+    {
+      l_length++;
+    }
+    if ( l_length > TRIX_MOVES_PATH_MAX )
+    {
+      continue;
+    }
+
+    p_placements[l_found].rotation = l_rotation[l_node];
+    p_placements[l_found].location = l_location;
+    p_placements[l_found].path_length = l_length;
+    for ( l_step = l_node; l_parent[l_step] != l_step; l_step = l_parent[l_step] )
+    {
+      p_placements[l_found].path[--l_length] = l_move[l_step];
+    }
+    l_found++;
+  }
+
+  /* Return how many placements we found. */
+  return l_found;
+}
+
+
+/*
+ * next_input - works out the next input to steer the current piece towards
+ *              the target placement, from wherever it is now; the path is
+ *              found afresh each time, so it doesn't matter if gravity has
+ *              moved the piece on since the target was chosen. Once only
+ *              gravity is left to do, the piece is dropped. Returns
+ *              INPUT_MAX if the target can no longer be reached.
+ */
+
+trix_input_t moves_next_input( const trix_core_st *p_core, const trix_placement_st *p_target )
+{
+  const trix_piece_st  *l_piece = core_state( p_core )->piece;
+  trix_placement_st     l_placements[TRIX_MOVES_MAX];
+  uint_fast16_t         l_count, l_index;
+  uint_fast8_t          l_step;
+
+  /* Without a piece, there's nothing to steer. */
+  if ( l_piece == NULL )
+  {
+    return INPUT_NONE;
+  }
+
+  /* Find the target among the places we can still reach. */
+  l_count = moves_find( p_core, l_placements, TRIX_MOVES_MAX );
+  for ( l_index = 0; l_index < l_count; l_index++ )
+  {
+    if ( ( l_piece->alias[l_placements[l_index].rotation] == l_piece->alias[p_target->rotation] ) &&
+         ( l_placements[l_index].location.x == p_target->location.x ) &&
+         ( l_placements[l_index].location.y == p_target->location.y ) )
+    {
+      break;
+    }
+  }
+  if ( l_index >= l_count )
+  {
+    return INPUT_MAX;
+  }
+
+  /* Take the first step of the path; if it's all gravity from here, drop. */
+  for ( l_step = 0; l_step < l_placements[l_index].path_length; l_step++ )
+  {
+    if ( l_placements[l_index].path[l_step] != INPUT_NONE )
+    {
+      return l_step == 0 ? l_placements[l_index].path[0] : INPUT_NONE;
+    }
+  }
+  return INPUT_DROP;
+}
+
+
+/* End of file moves.c */
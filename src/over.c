@@ -16,7 +16,6 @@
 #include <stdio.h>
 #include <string.h>
 #include "SDL.h"
-#include "SDL_image.h"
 
 
 /* Local headers. */
@@ -31,6 +30,8 @@ static bool           m_button_blink;
 static uint_fast32_t  m_cursor_tick;
 static bool           m_cursor_blink;
 static SDL_Texture   *m_sprite_texture;
+static SDL_Texture   *m_background_texture;
+static bool           m_background_redraw;
 static uint_fast32_t  m_start_tick;
 
 static SDL_Rect       m_title_src_rect;
@@ -57,133 +58,36 @@ static char           m_player_name[TRIX_NAMELEN_MAX+1];
 static const trix_gamestate_st  *m_gamestate;
 
 
-/* Functions. */
-
 /*
- * init - called when the engine is activated, to do any one-time initialising.
- */
-
-void over_init( void )
-{
-  char                    l_sprite_filename[TRIX_PATH_MAX+1];
-  uint_fast8_t            l_scale;
-  const trix_hiscore_st  *l_hiscore_table;
-
-  /* Load up the our spritesheet */
-  l_scale = display_find_asset( TRIX_ASSET_OVER_SPRITES, l_sprite_filename );
-  m_sprite_texture = IMG_LoadTexture( display_get_renderer(), l_sprite_filename );
-  if ( m_sprite_texture == NULL )
-  {
-    log_write( ERROR, "IMG_LoadTexture of %s failed - %s", TRIX_ASSET_OVER_SPRITES, SDL_GetError() );
-  }
-
-  /* Work out the appropriately scaled source and target rectangles for this. */
-  memcpy( &m_title_src_rect, 
-          display_scale_rect_to_scale( 0, 0, 125, 18, l_scale ), 
-          sizeof( SDL_Rect ) );  
-  memcpy( &m_main_button_src_rect,
-          display_scale_rect_to_scale( 0, 20, 58, 10, l_scale ), 
-          sizeof( SDL_Rect ) );  
-  memcpy( &m_again_button_src_rect,
-          display_scale_rect_to_scale( 58, 20, 58, 10, l_scale ), 
-          sizeof( SDL_Rect ) );  
-
-  memcpy( &m_title_target_rect,
-          display_scale_rect_to_screen( 17, 1, 125, 18 ), sizeof( SDL_Rect ) );
-  memcpy( &m_main_button_target_rect,
-          display_scale_rect_to_screen( 51, 75, 58, 10 ), sizeof( SDL_Rect ) );
-  memcpy( &m_main_button_deco_rect,
-          display_scale_rect_to_screen( 50, 74, 60, 12 ), sizeof( SDL_Rect ) );
-  memcpy( &m_again_button_target_rect,
-          display_scale_rect_to_screen( 51, 90, 58, 10 ), sizeof( SDL_Rect ) );
-  memcpy( &m_again_button_deco_rect,
-          display_scale_rect_to_screen( 50, 89, 60, 12 ), sizeof( SDL_Rect ) );
-
-  /* Clear any current command. */
-  m_current_cmd.sym = SDLK_UNKNOWN;
-  m_mouse_moved = false;
-  m_active_button = 2;
-
-  /* Check to see if it's a new high score. */
-  m_gamestate = game_state();
-  l_hiscore_table = hiscore_read( m_gamestate->mode );
-
-  /* We just need to have exceeded the last entry in the table! */
-  if ( m_gamestate->score > l_hiscore_table[TRIX_HISCORE_COUNT-1].score )
-  {
-    strncpy( m_player_name, config_get_string( CONF_PLAYERNAME ), TRIX_NAMELEN_MAX );
-    m_player_name[TRIX_NAMELEN_MAX] = '\0';
-    m_high_score = true;
-  }
-  else
-  {
-    m_high_score = false;
-  }
-
-  /* Remember what tick we were initialised at. */
-  m_blink_tick = m_start_tick = m_cursor_tick = SDL_GetTicks();
-
-  /* All done. */
-  return;
-}
-
-
-/*
- * event - called for every SDL event received; it's up to the engine what
- *         to do with them, but effects should be queued and handled within
- *         the update.
+ * Static functions; a collection of things only built for use locally.
  */
 
-void over_event( const SDL_Event *p_event )
-{
-  /* If it's a keypress, set the current command to this; yes, if the user */
-  /* presses multiple keys in the same frame, we may drop some. So, maybe  */
-  /* don't do that?!                                                       */
-  if ( p_event->type == SDL_KEYDOWN )
-  {
-    m_current_cmd = p_event->key.keysym;
-  }
-
-  /* If the mouse has moved, flag the movement and remember the location. */
-  if ( p_event->type == SDL_MOUSEMOTION )
-  {
-    m_mouse_moved = true;
-    m_mouse_location.x = p_event->motion.x;
-    m_mouse_location.y = p_event->motion.y;
-  }
-  if ( p_event->type == SDL_MOUSEBUTTONDOWN )
-  {
-    m_mouse_clicked = true;
-  }
-
-  /* All done. */
-  return;
-}
-
-
 /*
- * update - update the internal state of the engine; this is also where we
- *          handle and process any user input, but no drawing is done here.
+ * handle_input - deals with a single input from the queue, exactly as if it
+ *                were the only thing that had happened this frame.
  */
 
-trix_engine_t over_update( void )
+static trix_engine_t over_handle_input( const trix_queued_st *p_queued )
 {
-  uint_fast32_t l_current_tick = SDL_GetTicks();
   size_t        l_name_length;
   uint_fast8_t  l_index;
 
-  /* Blink the cursor on the menu. */
-  if ( l_current_tick >= ( m_blink_tick + TRIX_MOVE_MS ) )
-  {
-    m_button_blink = !m_button_blink;
-    m_blink_tick = l_current_tick;
-  }
-
-  /* And the text entry cursor. */
-  if ( l_current_tick >= ( m_cursor_tick + 300 ) )
+  /* Take the input into the current command, or the mouse state. */
+  switch( p_queued->type )
   {
-    m_cursor_blink = !m_cursor_blink;
-    m_cursor_tick = l_current_tick;
+    case QUEUED_KEY_DOWN:
+      m_current_cmd = p_queued->key;
+      break;
+    case QUEUED_MOTION:
+      m_mouse_moved = true;
+      m_mouse_location = p_queued->point;
+      break;
+    case QUEUED_CLICK:
+      m_mouse_clicked = true;
+      m_mouse_location = p_queued->point;
+      break;
+    default:
+      break;
   }
 
   /* Handle any mouse movements. */
@@ -304,6 +208,185 @@ trix_engine_t over_update( void )
 }
 
 
+/*
+ * draw_background - composes everything that doesn't change (the title, the
+ *                   buttons and the result of the game) into our background
+ *                   layer.
+ */
+
+static void over_draw_background( void )
+{
+  /* Draw into the layer, rather than the screen. */
+  SDL_SetRenderTarget( display_get_renderer(), m_background_texture );
+
+  /* Clear to black. */
+  SDL_SetRenderDrawColor( display_get_renderer(), 0, 0, 0, 255 );
+  SDL_RenderClear( display_get_renderer() );
+
+  /* Render the title, and buttons. */
+  SDL_RenderCopy( display_get_renderer(), m_sprite_texture, 
+                  &m_title_src_rect, &m_title_target_rect );
+  SDL_RenderCopy( display_get_renderer(), m_sprite_texture, 
+                  &m_main_button_src_rect, &m_main_button_target_rect );
+  SDL_RenderCopy( display_get_renderer(), m_sprite_texture, 
+                  &m_again_button_src_rect, &m_again_button_target_rect );
+
+  /* Drop in the score and lines of the completed game. */
+  text_draw_around( 80, 30, "You scored %05d with %d lines", 
+                    m_gamestate->score, m_gamestate->lines );
+
+  /* And whether or not that was a high score. */
+  if ( m_high_score )
+  {
+    text_draw_around( 80, 60, "This is a new high score!" );
+  }
+  else
+  {
+    text_draw_around( 80, 60, "This is not a new high score, %s", m_player_name );
+  }
+
+  /* And go back to drawing on the screen. */
+  SDL_SetRenderTarget( display_get_renderer(), NULL );
+  m_background_redraw = false;
+
+  /* All done. */
+  return;
+}
+
+
+/* Functions. */
+
+/*
+ * init - called when the engine is activated, to do any one-time initialising.
+ */
+
+void over_init( void )
+{
+  uint_fast8_t            l_scale;
+  const trix_hiscore_st  *l_hiscore_table;
+
+  /* Load up the our spritesheet */
+  m_sprite_texture = asset_acquire( TRIX_ASSET_OVER_SPRITES, &l_scale );
+  asset_prefetch( TRIX_ASSET_MENU_SPRITES );
+
+  /* Work out the appropriately scaled source and target rectangles for this. */
+  memcpy( &m_title_src_rect, 
+          display_scale_rect_to_scale( 0, 0, 125, 18, l_scale ), 
+          sizeof( SDL_Rect ) );  
+  memcpy( &m_main_button_src_rect,
+          display_scale_rect_to_scale( 0, 20, 58, 10, l_scale ), 
+          sizeof( SDL_Rect ) );  
+  memcpy( &m_again_button_src_rect,
+          display_scale_rect_to_scale( 58, 20, 58, 10, l_scale ), 
+          sizeof( SDL_Rect ) );  
+
+  memcpy( &m_title_target_rect,
+          display_scale_rect_to_screen( 17, 1, 125, 18 ), sizeof( SDL_Rect ) );
+  memcpy( &m_main_button_target_rect,
+          display_scale_rect_to_screen( 51, 75, 58, 10 ), sizeof( SDL_Rect ) );
+  memcpy( &m_main_button_deco_rect,
+          display_scale_rect_to_screen( 50, 74, 60, 12 ), sizeof( SDL_Rect ) );
+  memcpy( &m_again_button_target_rect,
+          display_scale_rect_to_screen( 51, 90, 58, 10 ), sizeof( SDL_Rect ) );
+  memcpy( &m_again_button_deco_rect,
+          display_scale_rect_to_screen( 50, 89, 60, 12 ), sizeof( SDL_Rect ) );
+
+  /* Clear any current command. */
+  m_current_cmd.sym = SDLK_UNKNOWN;
+  m_mouse_moved = false;
+  m_active_button = 2;
+
+  /* Check to see if it's a new high score. */
+  m_gamestate = game_state();
+  l_hiscore_table = hiscore_read( m_gamestate->mode );
+
+  /* We just need to have exceeded the last entry in the table! */
+  if ( m_gamestate->score > l_hiscore_table[TRIX_HISCORE_COUNT-1].score )
+  {
+    strncpy( m_player_name, config_get_string( CONF_PLAYERNAME ), TRIX_NAMELEN_MAX );
+    m_player_name[TRIX_NAMELEN_MAX] = '\0';
+    m_high_score = true;
+  }
+  else
+  {
+    m_high_score = false;
+  }
+
+  /* Everything that doesn't change is composed once, into a layer of its own. */
+  m_background_texture = display_create_layer();
+  m_background_redraw = true;
+
+  /* Remember what tick we were initialised at. */
+  m_blink_tick = m_start_tick = m_cursor_tick = SDL_GetTicks();
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * event - called for every SDL event received; it's up to the engine what
+ *         to do with them, but effects should be queued and handled within
+ *         the update.
+ */
+
+void over_event( const SDL_Event *p_event )
+{
+  /* Input reaches us through the queue; but if the renderer loses the */
+  /* contents of our background layer, it will need drawing again.     */
+  if ( ( p_event->type == SDL_RENDER_TARGETS_RESET ) ||
+       ( p_event->type == SDL_RENDER_DEVICE_RESET ) )
+  {
+    m_background_redraw = true;
+  }
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * update - update the internal state of the engine; this is also where we
+ *          handle and process any user input, but no drawing is done here.
+ */
+
+trix_engine_t over_update( void )
+{
+  trix_queued_st  l_queued;
+  trix_engine_t   l_target_engine;
+  uint_fast32_t   l_current_tick = SDL_GetTicks();
+
+  /* Blink the cursor on the menu. */
+  if ( l_current_tick >= ( m_blink_tick + TRIX_MOVE_MS ) )
+  {
+    m_button_blink = !m_button_blink;
+    m_blink_tick = l_current_tick;
+  }
+  sched_at( TIMER_BLINK, m_blink_tick + TRIX_MOVE_MS );
+
+  /* And the text entry cursor. */
+  if ( l_current_tick >= ( m_cursor_tick + 300 ) )
+  {
+    m_cursor_blink = !m_cursor_blink;
+    m_cursor_tick = l_current_tick;
+  }
+  sched_at( TIMER_CURSOR, m_cursor_tick + 300 );
+
+  /* Work through any queued input, in the order it happened. */
+  while ( input_pop( &l_queued ) )
+  {
+    l_target_engine = over_handle_input( &l_queued );
+    if ( l_target_engine != ENGINE_OVER )
+    {
+      return l_target_engine;
+    }
+  }
+
+  /* Stay in our present engine. */
+  return ENGINE_OVER;
+}
+
+
 /*
  * render - draws the internal state of the engine onto the screen; no logic
  *          should be here, it's all the presentational stuff.
@@ -313,11 +396,14 @@ void over_render( void )
 {
   SDL_Rect   l_name_size;
 
-  /* Clear to black. */
-  SDL_SetRenderDrawColor( display_get_renderer(), 0, 0, 0, 255 );
-  SDL_RenderClear( display_get_renderer() );
+  /* Start from the title, buttons and result, composed when they changed. */
+  if ( ( m_background_texture != NULL ) && ( m_background_redraw ) )
+  {
+    over_draw_background();
+  }
+  SDL_RenderCopy( display_get_renderer(), m_background_texture, NULL, NULL );
 
-  /* Fill in the button halo, if required. */
+  /* Fill in the button halo, if required, and draw the button back on top. */
   if ( m_active_button > 0 )
   {
     if ( m_button_blink )
@@ -333,24 +419,16 @@ void over_render( void )
   {
     case 1:
       SDL_RenderFillRect( display_get_renderer(), &m_main_button_deco_rect );  
+      SDL_RenderCopy( display_get_renderer(), m_sprite_texture, 
+                      &m_main_button_src_rect, &m_main_button_target_rect );
       break;
     case 2:
       SDL_RenderFillRect( display_get_renderer(), &m_again_button_deco_rect );  
+      SDL_RenderCopy( display_get_renderer(), m_sprite_texture, 
+                      &m_again_button_src_rect, &m_again_button_target_rect );
       break;
   }
 
-  /* Render the title, and buttons. */
-  SDL_RenderCopy( display_get_renderer(), m_sprite_texture, 
-                  &m_title_src_rect, &m_title_target_rect );
-  SDL_RenderCopy( display_get_renderer(), m_sprite_texture, 
-                  &m_main_button_src_rect, &m_main_button_target_rect );
-  SDL_RenderCopy( display_get_renderer(), m_sprite_texture, 
-                  &m_again_button_src_rect, &m_again_button_target_rect );
-
-  /* Drop in the score and lines of the completed game. */
-  text_draw_around( 80, 30, "You scored %05d with %d lines", 
-                    m_gamestate->score, m_gamestate->lines );
-
   /* And then, if required, render the name entry. */
   if ( m_high_score )
   {
@@ -366,11 +444,6 @@ void over_render( void )
     {
       text_draw( 80 - ( l_name_size.w / 2 ), 45, "%s_", m_player_name );
     }
-    text_draw_around( 80, 60, "This is a new high score!" );
-  }
-  else
-  {
-    text_draw_around( 80, 60, "This is not a new high score, %s", m_player_name );
   }
 
   /* Finally, render the metrics count. */
@@ -393,9 +466,14 @@ void over_fini( void )
   /* Release any loaded textures. */
   if ( m_sprite_texture != NULL )
   {
-    SDL_DestroyTexture( m_sprite_texture );
+    asset_release( m_sprite_texture );
     m_sprite_texture = NULL;
   }
+  if ( m_background_texture != NULL )
+  {
+    SDL_DestroyTexture( m_background_texture );
+    m_background_texture = NULL;
+  }
   
   /* All done. */
   return;
@@ -0,0 +1,191 @@
+/*
+ * pace.c - part of Tessalatrix
+ *
+ * The frame pacer; decides when the next frame may be drawn, keeping frames
+ * evenly spaced. Frame deadlines are kept in performance counter units and
+ * advanced by a whole frame at a time, so they never drift. Sleeping is only
+ * good to the nearest millisecond or so, so the last stretch before a
+ * deadline is spun out instead. In vsync mode, presenting the frame does the
+ * waiting for us, and we only keep an eye on how long it takes.
+ *
+ * Copyright (c) 2023 Pete Favelle <ahnlak@ahnlak.com>
+ *
+ * This file is released under the MIT License; see LICENSE for details.
+ */
+
+/* System headers. */
+
+#include <stdio.h>
+#include "SDL.h"
+
+
+/* Local headers. */
+
+#include "tessalatrix.h"
+
+
+/* Module variables. */
+
+static bool           m_vsync;
+static bool           m_pending;
+static uint64_t       m_wanted;
+static uint64_t       m_frequency;
+static uint64_t       m_period;
+static uint64_t       m_spin;
+static uint64_t       m_deadline;
+
+
+/* Functions. */
+
+/*
+ * init - sets up the pacer, either to time frames itself or to leave that to
+ *        vsync; in the latter case, frames are expected at the display's own
+ *        refresh rate.
+ */
+
+void pace_init( bool p_vsync )
+{
+  SDL_DisplayMode l_mode;
+  uint_fast32_t   l_rate = TRIX_FPS_RATE;
+
+  /* Browsers only ever call us once a frame, so it's vsync or nothing. */
+#ifdef __EMSCRIPTEN__
+  p_vsync = true;
+#endif
+
+  /* Vsync runs at whatever rate the display does, if we can find it out. */
+  m_vsync = p_vsync;
+  if ( ( m_vsync ) && ( SDL_GetDesktopDisplayMode( 0, &l_mode ) == 0 ) &&
+       ( l_mode.refresh_rate > 0 ) )
+  {
+    l_rate = l_mode.refresh_rate;
+  }
+
+  /* Work everything out in counter units. */
+  m_frequency = SDL_GetPerformanceFrequency();
+  m_period = m_frequency / l_rate;
+  m_spin = m_frequency * TRIX_PACE_SPIN_US / 1000000;
+  m_deadline = SDL_GetPerformanceCounter();
+  m_pending = false;
+
+  log_write( LOG, "Pacing frames at %d Hz%s", (int)l_rate, m_vsync ? ", with vsync" : "" );
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * want - called as soon as it's known that a frame will be drawn, before the
+ *        update that leads up to it; from then on, the frame is pending, and
+ *        any time taken to get it out counts against it.
+ */
+
+void pace_want( void )
+{
+  if ( !m_pending )
+  {
+    m_pending = true;
+    m_wanted = SDL_GetPerformanceCounter();
+  }
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * ready - returns true if a frame may be drawn now. If the deadline is close
+ *         enough, we spin until it arrives; any further off, false is
+ *         returned and the caller should come back after pace_wait().
+ */
+
+bool pace_ready( void )
+{
+  uint64_t  l_now = SDL_GetPerformanceCounter();
+
+  /* Once the deadline has passed, there's no reason to wait. */
+  if ( l_now >= m_deadline )
+  {
+    return true;
+  }
+
+  /* Otherwise, vsync does its own waiting, when the frame is presented. */
+  if ( m_vsync )
+  {
+    return true;
+  }
+
+  /* Too far off to spin for, so the frame has to wait. */
+  if ( m_deadline - l_now > m_spin )
+  {
+    return false;
+  }
+
+  /* Close enough; spin out the remainder. */
+  while ( SDL_GetPerformanceCounter() < m_deadline )
+  {
+    /* Nothing to do but wait. */
+  }
+  return true;
+}
+
+
+/*
+ * wait - returns how many milliseconds can safely be slept before the next
+ *        frame deadline, leaving enough time in hand to spin out the rest.
+ */
+
+uint_fast32_t pace_wait( void )
+{
+  uint64_t  l_now = SDL_GetPerformanceCounter();
+
+  if ( m_deadline <= l_now + m_spin )
+  {
+    return 0;
+  }
+  return (uint_fast32_t)( ( m_deadline - l_now - m_spin ) * 1000 / m_frequency );
+}
+
+
+/*
+ * frame - called once a frame has been presented, to set the next deadline.
+ *         If the frame went out a frame or more after it was due - its
+ *         deadline, or when it was wanted if that was later - the deadlines
+ *         it missed go to the metrics.
+ */
+
+void pace_frame( void )
+{
+  uint64_t  l_now = SDL_GetPerformanceCounter();
+  uint64_t  l_late = l_now > m_deadline ? l_now - m_deadline : 0;
+  uint64_t  l_due = m_deadline;
+
+  /* A frame nobody wanted until after its deadline was only due then. */
+  if ( ( m_pending ) && ( m_wanted > l_due ) )
+  {
+    l_due = m_wanted;
+  }
+  if ( ( m_pending ) && ( l_now >= l_due + m_period ) )
+  {
+    metrics_missed( ( l_now - l_due ) / m_period );
+  }
+  m_pending = false;
+
+  /* The next deadline is a frame on from this one; unless we're more than */
+  /* a frame behind (or have been idle), when it's a frame on from now.    */
+  if ( l_late < m_period )
+  {
+    m_deadline += m_period;
+  }
+  else
+  {
+    m_deadline = l_now + m_period;
+  }
+
+  /* All done. */
+  return;
+}
+
+
+/* End of file pace.c */
@@ -13,11 +13,12 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 
 /* Local headers. */
 
-#include "tessalatrix.h"
+#include "trixcore.h"
 
 
 /* Module variables. */
@@ -86,15 +87,167 @@ static trix_piece_st  m_pieces[] = {
  * Static functions; a collection of things only built for use locally.
  */
 
+/*
+ * build_mask - works out the packed collision mask for a single rotation of
+ *              a piece; the bounding box of the blocks, a row mask for each
+ *              row of that box (bit n being column min_x+n) and the lowest
+ *              block offset in each column.
+ */
+
+static void piece_build_mask( const trix_piece_st *p_piece, uint_fast8_t p_rotation,
+                              trix_piece_mask_st *p_mask )
+{
+  uint_fast8_t          l_index;
+  const trix_point_st  *l_block;
+
+  /* Start with an inside-out bounding box, and empty rows. */
+  memset( p_mask, 0, sizeof( trix_piece_mask_st ) );
+  p_mask->min_x = p_mask->min_y = INT_FAST8_MAX;
+  p_mask->max_x = p_mask->max_y = INT_FAST8_MIN;
+
+  /* First pass establishes the bounding box. */
+  for ( l_index = 0; l_index < p_piece->block_count; l_index++ )
+  {
+    l_block = &p_piece->blocks[p_rotation][l_index];
+    if ( l_block->x < p_mask->min_x )
+    {
+      p_mask->min_x = l_block->x;
+    }
+    if ( l_block->x > p_mask->max_x )
+    {
+      p_mask->max_x = l_block->x;
+    }
+    if ( l_block->y < p_mask->min_y )
+    {
+      p_mask->min_y = l_block->y;
+    }
+    if ( l_block->y > p_mask->max_y )
+    {
+      p_mask->max_y = l_block->y;
+    }
+  }
+  p_mask->height = p_mask->max_y - p_mask->min_y + 1;
+
+  /* Second pass fills in the row masks and column bottoms. */
+  for ( l_index = 0; l_index < 4; l_index++ )
+  {
+    p_mask->bottom[l_index] = INT_FAST8_MIN;
+  }
+  for ( l_index = 0; l_index < p_piece->block_count; l_index++ )
+  {
+    l_block = &p_piece->blocks[p_rotation][l_index];
+    p_mask->rows[l_block->y - p_mask->min_y] |= ( 1u << ( l_block->x - p_mask->min_x ) );
+    if ( l_block->y > p_mask->bottom[l_block->x - p_mask->min_x] )
+    {
+      p_mask->bottom[l_block->x - p_mask->min_x] = l_block->y;
+    }
+  }
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * same_mask - checks if two rotation masks describe exactly the same blocks.
+ */
+
+static bool piece_same_mask( const trix_piece_mask_st *p_a, const trix_piece_mask_st *p_b )
+{
+  uint_fast8_t  l_row;
+
+  /* Bounding boxes must match first. */
+  if ( ( p_a->min_x != p_b->min_x ) || ( p_a->min_y != p_b->min_y ) ||
+       ( p_a->height != p_b->height ) )
+  {
+    return false;
+  }
+
+  /* And then every row within them. */
+  for ( l_row = 0; l_row < p_a->height; l_row++ )
+  {
+    if ( p_a->rows[l_row] != p_b->rows[l_row] )
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+/*
+ * build_alias - works out, for each rotation, the lowest rotation which is
+ *               indistinguishable from it; that is, it has the same blocks
+ *               and so does every rotation that follows on from it. This lets
+ *               anything searching for moves treat symmetric rotations (like
+ *               all four of the square) as one.
+ */
+
+static void piece_build_alias( trix_piece_st *p_piece )
+{
+  uint_fast8_t  l_rotation, l_candidate, l_offset;
+
+  for ( l_rotation = 0; l_rotation < 4; l_rotation++ )
+  {
+    for ( l_candidate = 0; l_candidate < l_rotation; l_candidate++ )
+    {
+      /* Every subsequent rotation must line up, too. */
+      for ( l_offset = 0; l_offset < 4; l_offset++ )
+      {
+        if ( !piece_same_mask( &p_piece->masks[(l_rotation+l_offset)%4],
+                               &p_piece->masks[(l_candidate+l_offset)%4] ) )
+        {
+          break;
+        }
+      }
+      if ( l_offset == 4 )
+      {
+        break;
+      }
+    }
+    p_piece->alias[l_rotation] = l_candidate;
+  }
+
+  /* All done. */
+  return;
+}
+
 
 /* Functions. */
 
 /*
- * select - picks a suitable next piece, based on the specified game mode.
- *          Note that this returns a const pointer to our internal piece list.
+ * init - precalculates the collision masks (and rotational symmetries) for
+ *        every rotation of every piece; this must be called once at startup,
+ *        before any pieces are selected.
  */
 
-const trix_piece_st *piece_select( trix_gamemode_t p_mode )
+void piece_init( void )
+{
+  uint_fast8_t  l_piece, l_rotation;
+
+  /* Simply work through every rotation of every piece. */
+  for ( l_piece = 0; l_piece < ( sizeof( m_pieces ) / sizeof( m_pieces[0] ) ); l_piece++ )
+  {
+    for ( l_rotation = 0; l_rotation < 4; l_rotation++ )
+    {
+      piece_build_mask( &m_pieces[l_piece], l_rotation, &m_pieces[l_piece].masks[l_rotation] );
+    }
+    piece_build_alias( &m_pieces[l_piece] );
+  }
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * select - picks a suitable next piece, based on the specified game mode,
+ *          drawing on the game's own random number generator.
+ *          Note that this returns a const pointer to our internal piece list,
+ *          or NULL if the game mode is not one we know about.
+ */
+
+const trix_piece_st *piece_select( trix_gamemode_t p_mode, trix_rng_st *p_rng )
 {
   uint_fast8_t  l_chosen_piece;
   bool          l_good_pick = false;
@@ -104,7 +257,7 @@ const trix_piece_st *piece_select( trix_gamemode_t p_mode )
   do
   {
     /* Pick piece. */
-    l_chosen_piece = rand() % ( sizeof( m_pieces ) / sizeof( m_pieces[0] ) );
+    l_chosen_piece = rng_range( p_rng, sizeof( m_pieces ) / sizeof( m_pieces[0] ) );
 
     /* If it's valid for the game mode, stick with it. */
     switch( p_mode )
@@ -113,8 +266,8 @@ const trix_piece_st *piece_select( trix_gamemode_t p_mode )
         l_good_pick = true;
         break;
       default:
-        log_write( ERROR, "Invalid game mode in piece_select()" );
-        break;
+        /* No pieces are valid for an unknown mode, so don't keep trying. */
+        return NULL;
     }
   }
   while( !l_good_pick );
@@ -0,0 +1,111 @@
+/*
+ * rng.c - part of Tessalatrix
+ *
+ * A small, fast pseudo-random number generator (xoshiro128**), with all of
+ * its state held in a caller-owned structure. Every game carries its own, so
+ * piece sequences are reproducible from a seed and independent of any other
+ * game running alongside.
+ *
+ * Copyright (c) 2023 Pete Favelle <ahnlak@ahnlak.com>
+ *
+ * This file is released under the MIT License; see LICENSE for details.
+ */
+
+/* System headers. */
+
+#include <stdint.h>
+
+
+/* Local headers. */
+
+#include "trixcore.h"
+
+
+/*
+ * Static functions; a collection of things only built for use locally.
+ */
+
+/*
+ * rotl - rotates a 32 bit value left by the given number of bits.
+ */
+
+static inline uint32_t rng_rotl( uint32_t p_value, uint_fast8_t p_bits )
+{
+  return ( p_value << p_bits ) | ( p_value >> ( 32 - p_bits ) );
+}
+
+
+/*
+ * splitmix - the splitmix64 generator, used only to spread a seed across the
+ *            full state; it guarantees we never start with an all-zero state.
+ */
+
+static uint64_t rng_splitmix( uint64_t *p_seed )
+{
+  uint64_t  l_value;
+
+  l_value = ( *p_seed += UINT64_C(0x9E3779B97F4A7C15) );
+  l_value = ( l_value ^ ( l_value >> 30 ) ) * UINT64_C(0xBF58476D1CE4E5B9);
+  l_value = ( l_value ^ ( l_value >> 27 ) ) * UINT64_C(0x94D049BB133111EB);
+  return l_value ^ ( l_value >> 31 );
+}
+
+
+/* Functions. */
+
+/*
+ * seed - initialises the generator state from a single 64 bit seed; the same
+ *        seed will always produce the same sequence.
+ */
+
+void rng_seed( trix_rng_st *p_rng, uint64_t p_seed )
+{
+  uint64_t  l_value;
+
+  /* Fill the four words of state from two splitmix outputs. */
+  l_value = rng_splitmix( &p_seed );
+  p_rng->state[0] = (uint32_t)l_value;
+  p_rng->state[1] = (uint32_t)( l_value >> 32 );
+  l_value = rng_splitmix( &p_seed );
+  p_rng->state[2] = (uint32_t)l_value;
+  p_rng->state[3] = (uint32_t)( l_value >> 32 );
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * next - returns the next 32 bit value from the generator.
+ */
+
+uint32_t rng_next( trix_rng_st *p_rng )
+{
+  uint32_t  l_result, l_shifted;
+
+  l_result = rng_rotl( p_rng->state[1] * 5, 7 ) * 9;
+  l_shifted = p_rng->state[1] << 9;
+
+  p_rng->state[2] ^= p_rng->state[0];
+  p_rng->state[3] ^= p_rng->state[1];
+  p_rng->state[1] ^= p_rng->state[2];
+  p_rng->state[0] ^= p_rng->state[3];
+  p_rng->state[2] ^= l_shifted;
+  p_rng->state[3] = rng_rotl( p_rng->state[3], 11 );
+
+  return l_result;
+}
+
+
+/*
+ * range - returns a value from 0 to p_limit-1; this uses a multiply and shift
+ *         rather than a modulo, which is both faster and less biased.
+ */
+
+uint32_t rng_range( trix_rng_st *p_rng, uint32_t p_limit )
+{
+  return (uint32_t)( ( (uint64_t)rng_next( p_rng ) * p_limit ) >> 32 );
+}
+
+
+/* End of file rng.c */
@@ -0,0 +1,581 @@
+/*
+ * rollout.c - part of Tessalatrix
+ *
+ * A Monte-Carlo rollout player. The most promising placements for the current
+ * piece are each played out many times against random continuations of the
+ * piece sequence, with the core's own rules, and the placement which does best
+ * on average wins. Rollouts are shared out across a pool of worker threads,
+ * each with its own queue; workers which run dry steal from the others. The
+ * greedy choices made during rollouts are remembered in a lock-free table
+ * shared by all the workers, as the same positions come up again and again.
+ *
+ * Copyright (c) 2023 Pete Favelle <ahnlak@ahnlak.com>
+ *
+ * This file is released under the MIT License; see LICENSE for details.
+ */
+
+/* System headers. */
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef    TRIX_CORE_THREADS
+#include <unistd.h>
+#endif /* TRIX_CORE_THREADS */
+
+
+/* Local headers. */
+
+#include "trixcore.h"
+
+
+/* Atomic access; plain loads and stores do when there's only one thread. */
+
+#ifdef    TRIX_CORE_THREADS
+#define   rollout_load(p)         atomic_load_explicit( (p), memory_order_relaxed )
+#define   rollout_store(p,v)      atomic_store_explicit( (p), (v), memory_order_relaxed )
+#define   rollout_claim(p)        atomic_fetch_add_explicit( (p), 1, memory_order_relaxed )
+#else
+#define   rollout_load(p)         ( *(p) )
+#define   rollout_store(p,v)      ( *(p) = (v) )
+#define   rollout_claim(p)        ( (*(p))++ )
+#endif /* TRIX_CORE_THREADS */
+
+
+/*
+ * Static functions; a collection of things only built for use locally.
+ */
+
+/*
+ * hash - works out a hash of the board and the piece about to be placed on it;
+ *        pieces always start from the same place, so this is all that decides
+ *        where the greedy player would put it.
+ */
+
+static uint64_t rollout_hash( const trix_gamestate_st *p_state )
+{
+  uint_fast8_t  l_row;
+  uint64_t      l_hash;
+
+  l_hash = ( (uint64_t)p_state->piece->piece << 8 ) | p_state->rotation;
+  for ( l_row = 0; l_row < TRIX_BOARD_HEIGHT; l_row++ )
+  {
+    l_hash = ( l_hash ^ p_state->rows[l_row] ) * UINT64_C(0x9E3779B97F4A7C15);
+    l_hash ^= l_hash >> 29;
+  }
+
+  return l_hash;
+}
+
+
+/*
+ * place_greedy - puts the current piece wherever the evaluation likes best,
+ *                via the shared table if this position has been seen before.
+ *                The placement is applied with core_place, so it locks,
+ *                clears lines and spawns the next piece just as the game
+ *                would. Returns false if the game is over.
+ */
+
+static bool rollout_place_greedy( trix_rollout_st *p_rollout, trix_core_st *p_core )
+{
+  trix_rollout_entry_st  *l_entry;
+  trix_placement_st       l_choice;
+  uint64_t                l_key, l_data;
+  trix_point_st           l_below;
+
+  /* Have a look in the table; a torn entry simply fails the check. */
+  l_key = rollout_hash( core_state( p_core ) );
+  l_entry = &p_rollout->table[l_key & ( TRIX_ROLLOUT_TABLE_SIZE - 1 )];
+  l_data = rollout_load( &l_entry->data );
+  if ( ( l_data != 0 ) && ( ( rollout_load( &l_entry->check ) ^ l_data ) == l_key ) )
+  {
+    l_choice.rotation = ( l_data >> 16 ) & 0xFF;
+    l_choice.location.x = (int_fast16_t)( ( l_data >> 8 ) & 0xFF ) - 128;
+    l_choice.location.y = (int_fast16_t)( l_data & 0xFF ) - 128;
+
+    /* Even so, make sure it really is a resting place on this board. */
+    l_below = l_choice.location;
+    l_below.y++;
+    if ( ( !core_check_space( p_core, p_core->state.piece, l_choice.rotation, l_choice.location ) ) ||
+         ( core_check_space( p_core, p_core->state.piece, l_choice.rotation, l_below ) ) )
+    {
+      l_data = 0;
+    }
+  }
+  else
+  {
+    l_data = 0;
+  }
+
+  /* Not seen before, so work it out properly and remember it. */
+  if ( l_data == 0 )
+  {
+    if ( !eval_choose( p_core, &p_rollout->weights, &l_choice ) )
+    {
+      return false;
+    }
+    l_data = ( UINT64_C(1) << 24 ) | ( (uint64_t)l_choice.rotation << 16 ) |
+             ( (uint64_t)( l_choice.location.x + 128 ) << 8 ) | (uint64_t)( l_choice.location.y + 128 );
+    rollout_store( &l_entry->check, l_key ^ l_data );
+    rollout_store( &l_entry->data, l_data );
+  }
+
+  /* Put the piece in place, and let gravity lock it there. */
+  return core_place( p_core, l_choice.rotation, l_choice.location );
+}
+
+
+/*
+ * play - plays out a single rollout; the candidate placement is made, and
+ *        the game carries on for the horizon with a freshly seeded piece
+ *        sequence and the greedy player. The final board is scored just as
+ *        the evaluation would score it.
+ */
+
+static double rollout_play( trix_rollout_st *p_rollout, uint_fast32_t p_task )
+{
+  trix_core_st              l_core;
+  const trix_placement_st  *l_candidate;
+  uint_fast8_t              l_piece;
+
+  /* Every candidate sees the same continuations, which keeps it fair. */
+  l_candidate = &p_rollout->candidates[p_task / p_rollout->rollouts];
+  memcpy( &l_core, &p_rollout->root, sizeof( trix_core_st ) );
+  rng_seed( &l_core.rng, p_rollout->seed + p_task % p_rollout->rollouts );
+
+  /* Make the candidate move. */
+  if ( !core_place( &l_core, l_candidate->rotation, l_candidate->location ) )
+  {
+    return TRIX_EVAL_TOPPED_OUT;
+  }
+
+  /* And play on, greedily, until the horizon. */
+  for ( l_piece = 0; l_piece < p_rollout->horizon; l_piece++ )
+  {
+    if ( !rollout_place_greedy( p_rollout, &l_core ) )
+    {
+      return TRIX_EVAL_TOPPED_OUT + l_piece;
+    }
+  }
+
+  return eval_state( &l_core.state, l_core.state.lines - p_rollout->root.state.lines,
+                     &p_rollout->weights );
+}
+
+
+/*
+ * work - runs rollouts until there are none left anywhere, or p_limit of them
+ *        have been run; a worker empties its own queue first, then steals
+ *        from each of the others in turn. Every task is claimed with a single
+ *        atomic increment, so each is run exactly once, by whoever gets there
+ *        first. Returns true once there are no tasks left to claim.
+ */
+
+static bool rollout_work( trix_rollout_st *p_rollout, uint_fast8_t p_index,
+                          uint_fast32_t p_limit )
+{
+  trix_rollout_queue_st  *l_queue;
+  uint_fast32_t           l_task;
+  uint_fast8_t            l_victim;
+
+  for ( l_victim = 0; l_victim < p_rollout->threads; l_victim++ )
+  {
+    l_queue = &p_rollout->queues[( p_index + l_victim ) % p_rollout->threads];
+    while ( true )
+    {
+      if ( p_limit == 0 )
+      {
+        return false;
+      }
+      if ( ( l_task = rollout_claim( &l_queue->next ) ) >= l_queue->end )
+      {
+        break;
+      }
+      p_rollout->results[l_task] = rollout_play( p_rollout, l_task );
+      p_limit--;
+    }
+  }
+
+  /* All done. */
+  return true;
+}
+
+
+/*
+ * abandon - gives up on any rollouts still waiting to be run, and waits for
+ *           any the pool is part way through; afterwards, nobody is looking
+ *           at the job any more.
+ */
+
+static void rollout_abandon( trix_rollout_st *p_rollout )
+{
+  uint_fast8_t  l_slot;
+
+  /* Nothing more can be claimed once every queue is at its end. */
+  for ( l_slot = 0; l_slot < p_rollout->threads; l_slot++ )
+  {
+    rollout_store( &p_rollout->queues[l_slot].next, p_rollout->queues[l_slot].end );
+  }
+
+#ifdef    TRIX_CORE_THREADS
+  /* And whatever's already been claimed won't take long. */
+  pthread_mutex_lock( &p_rollout->lock );
+  while ( p_rollout->busy > 0 )
+  {
+    pthread_cond_wait( &p_rollout->done, &p_rollout->lock );
+  }
+  pthread_mutex_unlock( &p_rollout->lock );
+#endif /* TRIX_CORE_THREADS */
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * pick - averages out each candidate's rollouts, once they've all been run,
+ *        and copies the best of them into p_choice.
+ */
+
+static void rollout_pick( const trix_rollout_st *p_rollout, trix_placement_st *p_choice )
+{
+  double        l_score, l_best_score = 0.0;
+  uint_fast16_t l_rollout;
+  uint_fast8_t  l_slot, l_best = 0;
+
+  for ( l_slot = 0; l_slot < p_rollout->candidate_count; l_slot++ )
+  {
+    l_score = 0.0;
+    for ( l_rollout = 0; l_rollout < p_rollout->rollouts; l_rollout++ )
+    {
+      l_score += p_rollout->results[l_slot * p_rollout->rollouts + l_rollout];
+    }
+    if ( ( l_slot == 0 ) || ( l_score > l_best_score ) )
+    {
+      l_best = l_slot;
+      l_best_score = l_score;
+    }
+  }
+
+  /* Hand back the winner. */
+  memcpy( p_choice, &p_rollout->candidates[l_best], sizeof( trix_placement_st ) );
+
+  /* All done. */
+  return;
+}
+
+
+#ifdef    TRIX_CORE_THREADS
+/*
+ * worker - the body of each pool thread; it sleeps until there's a new batch
+ *          of work, helps with it, and reports back when it runs out.
+ */
+
+static void *rollout_worker( void *p_arg )
+{
+  trix_rollout_worker_st *l_worker = p_arg;
+  trix_rollout_st        *l_rollout = l_worker->owner;
+  uint_fast32_t           l_generation = 0;
+
+  pthread_mutex_lock( &l_rollout->lock );
+  while ( true )
+  {
+    /* Wait for something to do. */
+    while ( ( !l_rollout->stopping ) && ( l_rollout->generation == l_generation ) )
+    {
+      pthread_cond_wait( &l_rollout->wake, &l_rollout->lock );
+    }
+    if ( l_rollout->stopping )
+    {
+      break;
+    }
+    l_generation = l_rollout->generation;
+
+    /* Do it, outside of the lock. */
+    pthread_mutex_unlock( &l_rollout->lock );
+    rollout_work( l_rollout, l_worker->index, UINT_FAST32_MAX );
+    pthread_mutex_lock( &l_rollout->lock );
+
+    /* And let the caller know when the last of us is finished. */
+    if ( --l_rollout->busy == 0 )
+    {
+      pthread_cond_signal( &l_rollout->done );
+    }
+  }
+  pthread_mutex_unlock( &l_rollout->lock );
+
+  return NULL;
+}
+#endif /* TRIX_CORE_THREADS */
+
+
+/* Functions. */
+
+/*
+ * init - prepares the rollout player, starting up its pool of threads; zero
+ *        asks for one thread per processor. The calling thread always does
+ *        its share, so if no threads can be started, everything still works,
+ *        only slower. Returns false if the pool could not be set up at all.
+ */
+
+bool rollout_init( trix_rollout_st *p_rollout, uint_fast8_t p_threads )
+{
+#ifdef    TRIX_CORE_THREADS
+  uint_fast8_t  l_index;
+  long          l_processors;
+#endif /* TRIX_CORE_THREADS */
+
+  /* Start with an empty table, and no work. */
+  memset( p_rollout->table, 0, sizeof( p_rollout->table ) );
+  memset( &p_rollout->weights, 0, sizeof( p_rollout->weights ) );
+  memset( p_rollout->queues, 0, sizeof( p_rollout->queues ) );
+  p_rollout->threads = 1;
+  p_rollout->workers[0].owner = p_rollout;
+  p_rollout->workers[0].index = 0;
+
+#ifdef    TRIX_CORE_THREADS
+  /* Work out how many threads we want. */
+  if ( p_threads == 0 )
+  {
+    /* If we can't tell how many processors there are, assume just the one. */
+    l_processors = sysconf( _SC_NPROCESSORS_ONLN );
+    p_threads = l_processors < 1 ? 1 :
+                l_processors > TRIX_ROLLOUT_THREADS_MAX ? TRIX_ROLLOUT_THREADS_MAX : l_processors;
+  }
+  if ( p_threads > TRIX_ROLLOUT_THREADS_MAX )
+  {
+    p_threads = TRIX_ROLLOUT_THREADS_MAX;
+  }
+
+  /* Set up the signalling. */
+  p_rollout->generation = 0;
+  p_rollout->busy = 0;
+  p_rollout->stopping = false;
+  if ( ( pthread_mutex_init( &p_rollout->lock, NULL ) != 0 ) ||
+       ( pthread_cond_init( &p_rollout->wake, NULL ) != 0 ) ||
+       ( pthread_cond_init( &p_rollout->done, NULL ) != 0 ) )
+  {
+    return false;
+  }
+
+  /* And start up the pool; the caller is worker zero. */
+  for ( l_index = 1; l_index < p_threads; l_index++ )
+  {
+    p_rollout->workers[l_index].owner = p_rollout;
+    p_rollout->workers[l_index].index = l_index;
+    if ( pthread_create( &p_rollout->workers[l_index].thread, NULL,
+                         rollout_worker, &p_rollout->workers[l_index] ) != 0 )
+    {
+      break;
+    }
+    p_rollout->threads++;
+  }
+#endif /* TRIX_CORE_THREADS */
+
+  /* All done. */
+  return true;
+}
+
+
+/*
+ * fini - stops the pool of threads, and waits for them all to finish.
+ */
+
+void rollout_fini( trix_rollout_st *p_rollout )
+{
+#ifdef    TRIX_CORE_THREADS
+  uint_fast8_t  l_index;
+
+  /* Drop whatever the pool is in the middle of, and ask everyone to stop. */
+  rollout_abandon( p_rollout );
+  pthread_mutex_lock( &p_rollout->lock );
+  p_rollout->stopping = true;
+  pthread_cond_broadcast( &p_rollout->wake );
+  pthread_mutex_unlock( &p_rollout->lock );
+
+  /* And wait until they have. */
+  for ( l_index = 1; l_index < p_rollout->threads; l_index++ )
+  {
+    pthread_join( p_rollout->workers[l_index].thread, NULL );
+  }
+  pthread_cond_destroy( &p_rollout->done );
+  pthread_cond_destroy( &p_rollout->wake );
+  pthread_mutex_destroy( &p_rollout->lock );
+#endif /* TRIX_CORE_THREADS */
+
+  p_rollout->threads = 1;
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * start - sets the pool to work choosing the best placement for the current
+ *         piece by rollouts, without waiting for the answer; the few
+ *         placements the evaluation likes best are each played out
+ *         p_rollouts times, for p_horizon pieces beyond. The position is
+ *         copied, so the game can carry on meanwhile. Any earlier job still
+ *         running is abandoned. Returns false if the current piece has
+ *         nowhere to go at all.
+ */
+
+bool rollout_start( trix_rollout_st *p_rollout, const trix_core_st *p_core,
+                    const trix_weights_st *p_weights, uint_fast16_t p_rollouts,
+                    uint_fast8_t p_horizon )
+{
+  const trix_gamestate_st  *l_state = core_state( p_core );
+  trix_placement_st         l_placements[TRIX_MOVES_MAX];
+  trix_row_t                l_rows[TRIX_BOARD_HEIGHT];
+  double                    l_scores[TRIX_ROLLOUT_CANDIDATES];
+  double                    l_score;
+  trix_rng_st               l_rng;
+  uint_fast32_t             l_tasks;
+  uint_fast16_t             l_count, l_index;
+  uint_fast8_t              l_slot;
+
+  /* Make sure the pool has finished with the last job. */
+  rollout_abandon( p_rollout );
+
+  /* The table is only good for one set of weights. */
+  if ( memcmp( &p_rollout->weights, p_weights, sizeof( trix_weights_st ) ) != 0 )
+  {
+    memset( p_rollout->table, 0, sizeof( p_rollout->table ) );
+    memcpy( &p_rollout->weights, p_weights, sizeof( trix_weights_st ) );
+  }
+
+  /* Find everywhere this piece could go. */
+  l_count = moves_find( p_core, l_placements, TRIX_MOVES_MAX );
+  if ( l_count == 0 )
+  {
+    return false;
+  }
+
+  /* Keep the best few of them as candidates, in order. */
+  p_rollout->candidate_count = 0;
+  for ( l_index = 0; l_index < l_count; l_index++ )
+  {
+    l_score = eval_board( l_rows, l_state->board_width,
+                          eval_place( l_state->rows, l_state->full_row, l_state->piece,
+                                      l_placements[l_index].rotation,
+                                      l_placements[l_index].location, l_rows ),
+                          p_weights );
+    l_slot = p_rollout->candidate_count < TRIX_ROLLOUT_CANDIDATES ?
+             p_rollout->candidate_count++ : TRIX_ROLLOUT_CANDIDATES;
+    while ( ( l_slot > 0 ) && ( l_scores[l_slot-1] < l_score ) )
+    {
+      if ( l_slot < TRIX_ROLLOUT_CANDIDATES )
+      {
+        l_scores[l_slot] = l_scores[l_slot-1];
+        p_rollout->candidates[l_slot] = p_rollout->candidates[l_slot-1];
+      }
+      l_slot--;
+    }
+    if ( l_slot < TRIX_ROLLOUT_CANDIDATES )
+    {
+      l_scores[l_slot] = l_score;
+      p_rollout->candidates[l_slot] = l_placements[l_index];
+    }
+  }
+
+  /* Set out the job; continuations are seeded from the game's generator, */
+  /* so the same position always makes the same decision.                */
+  memcpy( &p_rollout->root, p_core, sizeof( trix_core_st ) );
+  p_rollout->rollouts = p_rollouts < 1 ? 1 : p_rollouts > TRIX_ROLLOUT_MAX ? TRIX_ROLLOUT_MAX : p_rollouts;
+  p_rollout->horizon = p_horizon;
+  l_rng = p_core->rng;
+  p_rollout->seed = ( (uint64_t)rng_next( &l_rng ) << 32 ) | rng_next( &l_rng );
+
+  /* Share the tasks out evenly between the queues. */
+  l_tasks = p_rollout->candidate_count * p_rollout->rollouts;
+  for ( l_slot = 0; l_slot < p_rollout->threads; l_slot++ )
+  {
+    rollout_store( &p_rollout->queues[l_slot].next, l_tasks * l_slot / p_rollout->threads );
+    p_rollout->queues[l_slot].end = l_tasks * ( l_slot + 1 ) / p_rollout->threads;
+  }
+
+#ifdef    TRIX_CORE_THREADS
+  /* And wake the pool. */
+  pthread_mutex_lock( &p_rollout->lock );
+  p_rollout->busy = p_rollout->threads - 1;
+  p_rollout->generation++;
+  pthread_cond_broadcast( &p_rollout->wake );
+  pthread_mutex_unlock( &p_rollout->lock );
+#endif /* TRIX_CORE_THREADS */
+
+  /* All done. */
+  return true;
+}
+
+
+/*
+ * poll - lends a hand with the job set out by rollout_start, running up to
+ *        p_tasks rollouts here; once every rollout has been run, the chosen
+ *        placement (and the path to reach it) is copied into p_choice and
+ *        ROLLOUT_DONE is returned. Until then, ROLLOUT_RUNNING if there may
+ *        be more to run here, or ROLLOUT_WAITING if there's nothing left to
+ *        do but wait for the pool to finish.
+ */
+
+trix_rollout_poll_t rollout_poll( trix_rollout_st *p_rollout, uint_fast32_t p_tasks,
+                                  trix_placement_st *p_choice )
+{
+#ifdef    TRIX_CORE_THREADS
+  uint_fast8_t  l_busy;
+#endif /* TRIX_CORE_THREADS */
+
+  /* Do some of the work ourselves, if there's any left. */
+  if ( !rollout_work( p_rollout, 0, p_tasks ) )
+  {
+    return ROLLOUT_RUNNING;
+  }
+
+#ifdef    TRIX_CORE_THREADS
+  /* And see if the pool has finished its share. */
+  pthread_mutex_lock( &p_rollout->lock );
+  l_busy = p_rollout->busy;
+  pthread_mutex_unlock( &p_rollout->lock );
+  if ( l_busy > 0 )
+  {
+    return ROLLOUT_WAITING;
+  }
+#endif /* TRIX_CORE_THREADS */
+
+  rollout_pick( p_rollout, p_choice );
+  return ROLLOUT_DONE;
+}
+
+
+/*
+ * choose - picks the best placement for the current piece by rollouts, just
+ *          as rollout_start does, but waits for the answer; the calling thread
+ *          does its share of the work. Returns false if the current piece has
+ *          nowhere to go at all.
+ */
+
+bool rollout_choose( trix_rollout_st *p_rollout, const trix_core_st *p_core,
+                     const trix_weights_st *p_weights, uint_fast16_t p_rollouts,
+                     uint_fast8_t p_horizon, trix_placement_st *p_choice )
+{
+  if ( !rollout_start( p_rollout, p_core, p_weights, p_rollouts, p_horizon ) )
+  {
+    return false;
+  }
+
+  /* Do our share, and wait for everyone else to finish. */
+  rollout_work( p_rollout, 0, UINT_FAST32_MAX );
+#ifdef    TRIX_CORE_THREADS
+  pthread_mutex_lock( &p_rollout->lock );
+  while ( p_rollout->busy > 0 )
+  {
+    pthread_cond_wait( &p_rollout->done, &p_rollout->lock );
+  }
+  pthread_mutex_unlock( &p_rollout->lock );
+#endif /* TRIX_CORE_THREADS */
+
+  rollout_pick( p_rollout, p_choice );
+  return true;
+}
+
+
+/* End of file rollout.c */
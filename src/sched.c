@@ -0,0 +1,224 @@
+/*
+ * sched.c - part of Tessalatrix
+ *
+ * The scheduler; keeps track of the next time anything is due to happen
+ * (gravity, a blinking cursor, the next frame and so on) so that the main
+ * loop can sleep right up until then, or until some input arrives, rather
+ * than polling every frame. Each timer is a one-shot deadline, held in a
+ * small binary heap ordered by when it falls due.
+ *
+ * Copyright (c) 2023 Pete Favelle <ahnlak@ahnlak.com>
+ *
+ * This file is released under the MIT License; see LICENSE for details.
+ */
+
+/* System headers. */
+
+#include <stdio.h>
+#include "SDL.h"
+
+
+/* Local headers. */
+
+#include "tessalatrix.h"
+
+
+/* Constants. */
+
+#define   TRIX_SCHED_UNARMED    -1
+
+
+/* Module variables. */
+
+static trix_timer_t   m_heap[TIMER_MAX];
+static uint_fast8_t   m_heap_size;
+static int_fast8_t    m_position[TIMER_MAX];
+static uint_fast32_t  m_deadline[TIMER_MAX];
+
+
+/*
+ * Static functions; a collection of things only built for use locally.
+ */
+
+/*
+ * before - compares two timers; deadlines are in SDL ticks, which can wrap,
+ *          so the difference is what counts.
+ */
+
+static bool sched_before( trix_timer_t p_a, trix_timer_t p_b )
+{
+  return (int32_t)( m_deadline[p_a] - m_deadline[p_b] ) < 0;
+}
+
+
+/*
+ * swap - exchanges two entries in the heap, keeping positions up to date.
+ */
+
+static void sched_swap( uint_fast8_t p_a, uint_fast8_t p_b )
+{
+  trix_timer_t  l_timer = m_heap[p_a];
+
+  m_heap[p_a] = m_heap[p_b];
+  m_heap[p_b] = l_timer;
+  m_position[m_heap[p_a]] = p_a;
+  m_position[m_heap[p_b]] = p_b;
+  return;
+}
+
+
+/*
+ * sift - moves a heap entry up or down until it's in the right place.
+ */
+
+static void sched_sift( uint_fast8_t p_index )
+{
+  uint_fast8_t  l_child;
+
+  /* Up, while it's due before its parent... */
+  while ( ( p_index > 0 ) && sched_before( m_heap[p_index], m_heap[(p_index-1)/2] ) )
+  {
+    sched_swap( p_index, (p_index-1)/2 );
+    p_index = (p_index-1)/2;
+  }
+
+  /* ...or down, while either child is due before it. */
+  while ( ( l_child = 2 * p_index + 1 ) < m_heap_size )
+  {
+    if ( ( l_child + 1 < m_heap_size ) && sched_before( m_heap[l_child+1], m_heap[l_child] ) )
+    {
+      l_child++;
+    }
+    if ( !sched_before( m_heap[l_child], m_heap[p_index] ) )
+    {
+      break;
+    }
+    sched_swap( p_index, l_child );
+    p_index = l_child;
+  }
+
+  /* All done. */
+  return;
+}
+
+
+/* Functions. */
+
+/*
+ * init - clears out every timer; called whenever engines change, so that the
+ *        new engine starts with nothing pending.
+ */
+
+void sched_init( void )
+{
+  uint_fast8_t  l_index;
+
+  for ( l_index = 0; l_index < TIMER_MAX; l_index++ )
+  {
+    m_position[l_index] = TRIX_SCHED_UNARMED;
+  }
+  m_heap_size = 0;
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * at - sets a timer to fall due at the given tick; if it's already set, it's
+ *      simply moved.
+ */
+
+void sched_at( trix_timer_t p_timer, uint_fast32_t p_tick )
+{
+  m_deadline[p_timer] = p_tick;
+  if ( m_position[p_timer] == TRIX_SCHED_UNARMED )
+  {
+    m_heap[m_heap_size] = p_timer;
+    m_position[p_timer] = m_heap_size++;
+  }
+  sched_sift( m_position[p_timer] );
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * cancel - stops a timer, if it was set.
+ */
+
+void sched_cancel( trix_timer_t p_timer )
+{
+  int_fast8_t l_index = m_position[p_timer];
+
+  if ( l_index == TRIX_SCHED_UNARMED )
+  {
+    return;
+  }
+
+  /* Move the last entry into the hole, and let it find its own level. */
+  m_position[p_timer] = TRIX_SCHED_UNARMED;
+  if ( l_index < --m_heap_size )
+  {
+    m_heap[l_index] = m_heap[m_heap_size];
+    m_position[m_heap[l_index]] = l_index;
+    sched_sift( l_index );
+  }
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * armed - returns true if the timer is set, and hasn't yet fallen due.
+ */
+
+bool sched_armed( trix_timer_t p_timer )
+{
+  return m_position[p_timer] != TRIX_SCHED_UNARMED;
+}
+
+
+/*
+ * expire - removes every timer that has fallen due by the given tick; they
+ *          are one-shot, so whoever set them must set them again if needed.
+ *          Returns true if any did.
+ */
+
+bool sched_expire( uint_fast32_t p_tick )
+{
+  bool  l_expired = false;
+
+  while ( ( m_heap_size > 0 ) && ( (int32_t)( m_deadline[m_heap[0]] - p_tick ) <= 0 ) )
+  {
+    sched_cancel( m_heap[0] );
+    l_expired = true;
+  }
+
+  return l_expired;
+}
+
+
+/*
+ * wait - returns how many milliseconds there are, from the given tick, until
+ *        the next timer falls due; if nothing is set at all, a long idle wait
+ *        is returned instead.
+ */
+
+uint_fast32_t sched_wait( uint_fast32_t p_tick )
+{
+  if ( m_heap_size == 0 )
+  {
+    return TRIX_SCHED_IDLE_MS;
+  }
+  if ( (int32_t)( m_deadline[m_heap[0]] - p_tick ) <= 0 )
+  {
+    return 0;
+  }
+  return (uint32_t)( m_deadline[m_heap[0]] - p_tick );
+}
+
+
+/* End of file sched.c */
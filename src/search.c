@@ -0,0 +1,335 @@
+/*
+ * search.c - part of Tessalatrix
+ *
+ * A beam search over final placements, looking ahead through the upcoming
+ * pieces. Each ply expands the best boards from the ply before into every
+ * placement of the next piece, and only the best few survive into the next.
+ * Boards reached by more than one route are spotted with a Zobrist hash, kept
+ * up to date as pieces are placed, so each is only expanded once. Every node
+ * comes out of an arena within the caller's trix_search_st, which is simply
+ * reset at the start of each search; nothing is allocated along the way.
+ *
+ * Copyright (c) 2023 Pete Favelle <ahnlak@ahnlak.com>
+ *
+ * This file is released under the MIT License; see LICENSE for details.
+ */
+
+/* System headers. */
+
+#include <stdint.h>
+#include <string.h>
+
+
+/* Local headers. */
+
+#include "trixcore.h"
+
+
+/* Constants. */
+
+#define   TRIX_SEARCH_ZOBRIST_SEED  UINT64_C(0x7E55A1A7121C0DE5)
+
+
+/*
+ * Static functions; a collection of things only built for use locally.
+ */
+
+/*
+ * hash_board - works out the Zobrist hash of a whole board from scratch; only
+ *              needed at the root, or when clearing lines has moved rows.
+ */
+
+static uint64_t search_hash_board( const trix_search_st *p_search, const trix_row_t *p_rows )
+{
+  uint_fast8_t  l_row, l_column;
+  trix_row_t    l_bits;
+  uint64_t      l_hash = 0;
+
+  for ( l_row = 0; l_row < TRIX_BOARD_HEIGHT; l_row++ )
+  {
+    for ( l_column = 0, l_bits = p_rows[l_row]; l_bits != 0; l_column++, l_bits >>= 1 )
+    {
+      if ( l_bits & 1 )
+      {
+        l_hash ^= p_search->zobrist[l_row][l_column];
+      }
+    }
+  }
+
+  return l_hash;
+}
+
+
+/*
+ * hash_piece - works out the hash of just the cells a piece would add to the
+ *              board; XORing this in updates a board hash for the placement.
+ */
+
+static uint64_t search_hash_piece( const trix_search_st *p_search, const trix_piece_st *p_piece,
+                                   uint_fast8_t p_rotation, trix_point_st p_location )
+{
+  uint_fast8_t  l_index;
+  int_fast16_t  l_y;
+  uint64_t      l_hash = 0;
+
+  for ( l_index = 0; l_index < p_piece->block_count; l_index++ )
+  {
+    l_y = p_location.y + p_piece->blocks[p_rotation][l_index].y;
+    if ( l_y >= 0 )
+    {
+      l_hash ^= p_search->zobrist[l_y][p_location.x + p_piece->blocks[p_rotation][l_index].x];
+    }
+  }
+
+  return l_hash;
+}
+
+
+/*
+ * expand - adds a node to the arena for every placement of the piece on the
+ *          parent board, merging any board we've already seen this ply into
+ *          the better scoring of the two, and offers each survivor up for
+ *          the next beam.
+ */
+
+static void search_expand( trix_search_st *p_search, const trix_row_t *p_rows,
+                           uint64_t p_hash, uint_fast16_t p_lines, int_fast16_t p_first,
+                           const trix_placement_st *p_placements, uint_fast16_t p_count,
+                           const trix_weights_st *p_weights )
+{
+  const trix_gamestate_st  *l_state = core_state( &p_search->scratch );
+  trix_search_node_st      *l_node, *l_seen;
+  uint_fast16_t             l_index, l_slot, l_arena;
+  uint_fast8_t              l_lines, l_beam;
+
+  for ( l_index = 0; l_index < p_count; l_index++ )
+  {
+    /* If the arena is full, this ply will just have to make do. */
+    if ( p_search->arena_used >= TRIX_SEARCH_NODES_MAX )
+    {
+      return;
+    }
+    l_node = &p_search->arena[p_search->arena_used];
+
+    /* Place the piece, and update the hash to match. */
+    l_lines = eval_place( p_rows, l_state->full_row, l_state->piece,
+                          p_placements[l_index].rotation, p_placements[l_index].location,
+                          l_node->rows );
+    if ( l_lines > 0 )
+    {
+      l_node->hash = search_hash_board( p_search, l_node->rows );
+    }
+    else
+    {
+      l_node->hash = p_hash ^ search_hash_piece( p_search, l_state->piece,
+                                                 p_placements[l_index].rotation,
+                                                 p_placements[l_index].location );
+    }
+
+    /* Score it, exactly as the single piece evaluation would. */
+    l_node->lines = p_lines + l_lines;
+    l_node->first = p_first < 0 ? (uint16_t)l_index : (uint16_t)p_first;
+    l_node->score = eval_board( l_node->rows, l_state->board_width, l_node->lines, p_weights );
+    if ( p_placements[l_index].location.y +
+         l_state->piece->masks[p_placements[l_index].rotation].min_y < 0 )
+    {
+      l_node->score += TRIX_EVAL_TOPPED_OUT;
+    }
+
+    /* Look for this board in the table; the same board can be reached   */
+    /* by routes that cleared different lines or topped out on the way, */
+    /* so if we've seen it, only the better scoring route is kept.      */
+    for ( l_slot = l_node->hash & ( TRIX_SEARCH_TABLE_SIZE - 1 );
+          p_search->table[l_slot] != 0;
+          l_slot = ( l_slot + 1 ) & ( TRIX_SEARCH_TABLE_SIZE - 1 ) )
+    {
+      l_seen = &p_search->arena[p_search->table[l_slot] - 1];
+      if ( ( l_seen->hash == l_node->hash ) &&
+           ( memcmp( l_seen->rows, l_node->rows, sizeof( l_node->rows ) ) == 0 ) )
+      {
+        break;
+      }
+    }
+    if ( p_search->table[l_slot] != 0 )
+    {
+      if ( l_node->score <= l_seen->score )
+      {
+        continue;
+      }
+      l_seen->score = l_node->score;
+      l_seen->lines = l_node->lines;
+      l_seen->first = l_node->first;
+      l_arena = p_search->table[l_slot] - 1;
+
+      /* It may already be in the beam, in which case it moves up from  */
+      /* where it is; if not, it's offered up just like a new board.    */
+      l_beam = 0;
+      while ( ( l_beam < p_search->next_size ) && ( p_search->next[l_beam] != l_arena ) )
+      {
+        l_beam++;
+      }
+    }
+    else
+    {
+      p_search->table[l_slot] = ++p_search->arena_used;
+      l_arena = p_search->arena_used - 1;
+      l_seen = l_node;
+      l_beam = p_search->next_size;
+    }
+
+    /* Offer it up to the next beam, which is kept sorted best first. */
+    if ( l_beam == p_search->next_size )
+    {
+      l_beam = p_search->next_size < TRIX_SEARCH_BEAM_WIDTH ? p_search->next_size++ : TRIX_SEARCH_BEAM_WIDTH;
+    }
+    while ( ( l_beam > 0 ) &&
+            ( p_search->arena[p_search->next[l_beam-1]].score < l_seen->score ) )
+    {
+      if ( l_beam < TRIX_SEARCH_BEAM_WIDTH )
+      {
+        p_search->next[l_beam] = p_search->next[l_beam-1];
+      }
+      l_beam--;
+    }
+    if ( l_beam < TRIX_SEARCH_BEAM_WIDTH )
+    {
+      p_search->next[l_beam] = l_arena;
+    }
+  }
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * start_ply - gets ready to build the next ply; an empty beam and a fresh
+ *             table, so that boards are only compared within the ply.
+ */
+
+static void search_start_ply( trix_search_st *p_search )
+{
+  memset( p_search->table, 0, sizeof( p_search->table ) );
+  p_search->next_size = 0;
+  return;
+}
+
+
+/*
+ * end_ply - promotes the freshly built beam to be the current one; if the
+ *           ply produced nothing at all, the current beam is left alone and
+ *           false is returned.
+ */
+
+static bool search_end_ply( trix_search_st *p_search )
+{
+  if ( p_search->next_size == 0 )
+  {
+    return false;
+  }
+
+  memcpy( p_search->beam, p_search->next, sizeof( p_search->beam[0] ) * p_search->next_size );
+  p_search->beam_size = p_search->next_size;
+  return true;
+}
+
+
+/* Functions. */
+
+/*
+ * init - prepares a search context for use; this just fills the Zobrist
+ *        table, from a fixed seed so that searches are repeatable.
+ */
+
+void search_init( trix_search_st *p_search )
+{
+  uint_fast8_t  l_row, l_column;
+  trix_rng_st   l_rng;
+
+  rng_seed( &l_rng, TRIX_SEARCH_ZOBRIST_SEED );
+  for ( l_row = 0; l_row < TRIX_BOARD_HEIGHT; l_row++ )
+  {
+    for ( l_column = 0; l_column < TRIX_BOARD_ROW_MAX; l_column++ )
+    {
+      p_search->zobrist[l_row][l_column] = ( (uint64_t)rng_next( &l_rng ) << 32 ) | rng_next( &l_rng );
+    }
+  }
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * choose - picks the best placement for the current piece, looking ahead up
+ *          to p_depth pieces into the preview. The chosen placement (and the
+ *          path to reach it) is copied into p_choice; returns false if the
+ *          current piece has nowhere to go at all.
+ */
+
+bool search_choose( trix_search_st *p_search, const trix_core_st *p_core,
+                    const trix_weights_st *p_weights, uint_fast8_t p_depth,
+                    trix_placement_st *p_choice )
+{
+  const trix_piece_st  *l_preview[TRIX_SEARCH_DEPTH_MAX];
+  uint_fast8_t          l_rotations[TRIX_SEARCH_DEPTH_MAX];
+  trix_placement_st     l_placements[TRIX_MOVES_MAX];
+  trix_search_node_st  *l_parent;
+  uint_fast16_t         l_root_count, l_count;
+  uint_fast8_t          l_ply, l_index;
+
+  /* Start with an empty arena, and a scratch copy of the game to plan on. */
+  p_search->arena_used = 0;
+  memcpy( &p_search->scratch, p_core, sizeof( trix_core_st ) );
+
+  /* Find everywhere the current piece could go; these are our roots. */
+  l_root_count = moves_find( p_core, p_search->roots, TRIX_MOVES_MAX );
+  if ( l_root_count == 0 )
+  {
+    return false;
+  }
+  search_start_ply( p_search );
+  search_expand( p_search, core_state( p_core )->rows,
+                 search_hash_board( p_search, core_state( p_core )->rows ), 0, -1,
+                 p_search->roots, l_root_count, p_weights );
+  search_end_ply( p_search );
+
+  /* Then work through the preview, a ply at a time. */
+  if ( p_depth > TRIX_SEARCH_DEPTH_MAX )
+  {
+    p_depth = TRIX_SEARCH_DEPTH_MAX;
+  }
+  p_depth = core_preview( p_core, l_preview, l_rotations, p_depth );
+  for ( l_ply = 0; l_ply < p_depth; l_ply++ )
+  {
+    search_start_ply( p_search );
+    for ( l_index = 0; l_index < p_search->beam_size; l_index++ )
+    {
+      /* Put the previewed piece at the top of this board, as the game would. */
+      l_parent = &p_search->arena[p_search->beam[l_index]];
+      memcpy( p_search->scratch.state.rows, l_parent->rows, sizeof( l_parent->rows ) );
+      p_search->scratch.state.piece = l_preview[l_ply];
+      p_search->scratch.state.rotation = l_rotations[l_ply];
+      p_search->scratch.state.location = core_spawn_location( &p_search->scratch );
+
+      /* If it won't fit, this board ends the game; go no further with it. */
+      l_count = moves_find( &p_search->scratch, l_placements, TRIX_MOVES_MAX );
+      search_expand( p_search, l_parent->rows, l_parent->hash, l_parent->lines,
+                     l_parent->first, l_placements, l_count, p_weights );
+    }
+
+    /* If every board ended the game, stick with what we had. */
+    if ( !search_end_ply( p_search ) )
+    {
+      break;
+    }
+  }
+
+  /* The best board left decides which root we take. */
+  memcpy( p_choice, &p_search->roots[p_search->arena[p_search->beam[0]].first],
+          sizeof( trix_placement_st ) );
+  return true;
+}
+
+
+/* End of file search.c */
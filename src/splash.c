@@ -14,7 +14,6 @@
 
 #include <stdio.h>
 #include "SDL.h"
-#include "SDL_image.h"
 
 
 /* Local headers. */
@@ -38,16 +37,17 @@ static SDL_Rect       m_target_rect;
 
 void splash_init( void )
 {
-  char          l_splash_filename[TRIX_PATH_MAX+1];
   uint_fast8_t  l_scale;
 
   /* Load up the splash image (hopefully!) */
-  l_scale = display_find_asset( TRIX_ASSET_SPLASH, l_splash_filename );
-  m_splash_texture = IMG_LoadTexture( display_get_renderer(), l_splash_filename );
-  if ( m_splash_texture == NULL )
-  {
-    log_write( ERROR, "IMG_LoadTexture of %s failed - %s", TRIX_ASSET_SPLASH, SDL_GetError() );
-  }
+  m_splash_texture = asset_acquire( TRIX_ASSET_SPLASH, &l_scale );
+
+  /* While that's on screen, everything else can be decoded behind it. */
+  asset_prefetch( TRIX_ASSET_MENU_SPRITES );
+  asset_prefetch( TRIX_ASSET_GAME_SPRITES );
+  asset_prefetch( TRIX_ASSET_OVER_SPRITES );
+  asset_prefetch( TRIX_ASSET_HST_SPRITES );
+  asset_prefetch( TRIX_ASSET_METRICS_SPRITES );
 
   /* Work out the appropriately scaled target rectangle for this. */
   memcpy( &m_target_rect, 
@@ -108,22 +108,24 @@ trix_engine_t splash_update( void )
   {
     /* In the first phase, we fade up the alpha. */
     l_alpha = ( l_ticks_passed * 255 ) / l_speed;
-
+    sched_at( TIMER_ANIMATION, m_start_tick + l_ticks_passed + TRIX_FPS_MS );
   }
   else if ( l_ticks_passed < ( l_speed * 2 ) )
   {
-    /* In the second phase, just hold the splash. */
+    /* In the second phase, just hold the splash; nothing to do until then. */
     l_alpha = 255;
+    sched_at( TIMER_ANIMATION, m_start_tick + l_speed * 2 );
   }
   else if ( l_ticks_passed < ( l_speed * 3 ) )
   {
     /* In the third phase, we fade it back down again. */
     l_alpha = 255 - ( ( l_ticks_passed-l_speed-l_speed ) * 255 ) / l_speed;
+    sched_at( TIMER_ANIMATION, m_start_tick + l_ticks_passed + TRIX_FPS_MS );
   }
   else
   {
     /* And the end of it, we jump to the next engine. */
-    return ENGINE_MENU;
+    return config_get_int( CONF_AUTOPLAY ) ? ENGINE_AI : ENGINE_MENU;
   }
 
   /* Set the alpha on the splash image to an appropriate value. */
@@ -170,7 +172,7 @@ void splash_fini( void )
   /* Release any loaded textures. */
   if ( m_splash_texture != NULL )
   {
-    SDL_DestroyTexture( m_splash_texture );
+    asset_release( m_splash_texture );
     m_splash_texture = NULL;
   }
   
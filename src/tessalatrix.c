@@ -13,7 +13,6 @@
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <time.h>
 #include "SDL.h"
 
 #ifdef __EMSCRIPTEN__
@@ -39,11 +38,18 @@ void main_loop( void *p_arg )
   SDL_Event             l_event;
   trix_engine_t         l_target_engine;
   trix_engine_st       *l_current_engine = p_arg;
-  uint_fast32_t         l_this_tick;
-  static uint_fast32_t  l_last_tick;
+  bool                  l_pending, l_redraw;
 
-  /* So, work through any queued up events. */
-  while( SDL_PollEvent( &l_event ) != 0 )
+  /* Sleep until the next thing is due, or something happens; browsers call */
+  /* us once a frame anyway, and won't let us sleep at all.                 */
+#ifdef __EMSCRIPTEN__
+  l_pending = SDL_PollEvent( &l_event );
+#else
+  l_pending = SDL_WaitEventTimeout( &l_event, sched_wait( SDL_GetTicks() ) );
+#endif
+
+  /* So, work through that and any other queued up events. */
+  for ( l_redraw = l_pending; l_pending; l_pending = SDL_PollEvent( &l_event ) )
   {
     /* Handle the system-level events. */
     if ( l_event.type == SDL_QUIT )
@@ -58,7 +64,15 @@ void main_loop( void *p_arg )
       metrics_toggle();
     }
 
-    /* And pass any remaining events into the current engine. */
+    /* Rendered text runs are lost along with any other render targets. */
+    if ( ( l_event.type == SDL_RENDER_TARGETS_RESET ) ||
+         ( l_event.type == SDL_RENDER_DEVICE_RESET ) )
+    {
+      text_flush();
+    }
+
+    /* Queue up any input, and pass every event into the current engine. */
+    input_push( &l_event );
     l_current_engine->event( &l_event );
   }
 
@@ -68,8 +82,22 @@ void main_loop( void *p_arg )
     return;
   }
 
-  /* Ask the current engine to update. */
+  /* Anything that has fallen due probably changes what's on screen. */
+  if ( sched_expire( SDL_GetTicks() ) )
+  {
+    l_redraw = true;
+  }
+
+  /* From here on, any frame we're going to draw is held up by the update. */
+  if ( l_redraw )
+  {
+    pace_want();
+  }
+
+  /* Ask the current engine to update; it sets any timers it needs, and */
+  /* works through whatever input it wants from the queue.              */
   l_target_engine = l_current_engine->update();
+  input_flush();
 
   /* If the engine has requested a switch, do so and move straight on. */
   if ( l_target_engine != l_current_engine->type )
@@ -116,39 +144,50 @@ void main_loop( void *p_arg )
         l_current_engine->fini   = over_fini;
         break;
 
+      case ENGINE_AI:         /* Let the autoplayer show us how. */
+        l_current_engine->type   = ENGINE_AI;
+        l_current_engine->init   = ai_init;
+        l_current_engine->event  = ai_event;
+        l_current_engine->update = ai_update;
+        l_current_engine->render = ai_render;
+        l_current_engine->fini   = ai_fini;
+        break;
+
       case ENGINE_EXIT:           /* We want to exit the game now. */
       default:
         l_current_engine->running = false;
         return;
     }
 
-    /* Run any initialisation for the new engine. */
+    /* Run any initialisation for the new engine, with no timers pending */
+    /* but a frame due straight away.                                   */
+    sched_init();
     l_current_engine->init();
+    sched_at( TIMER_FRAME, SDL_GetTicks() );
 
     /* And move straight on with the next loop. */
     return;
   }
 
-  /* Get the current tick count, to see how good our performance is. */
-  l_this_tick = SDL_GetTicks();
-
-  /* Only render if we have enough time (aim for 60fps ~ 16.7ms) */
-  if ( ( l_this_tick - l_last_tick ) <= TRIX_FPS_MS )
+  /* Only render if something may have changed, and only once the pacer    */
+  /* says the next frame is due; if it's not, come back in time for it.    */
+  if ( l_redraw )
   {
-    /* And then to render itself (if we have time) */
-    l_current_engine->render();
-
-    /* Keep track of our performance metrics. */
-    metrics_update();
+    if ( pace_ready() )
+    {
+      l_current_engine->render();
+      pace_frame();
+      sched_cancel( TIMER_FRAME );
 
-    /* Wait for the next frame, if we need to. */
-    SDL_Delay( TRIX_FPS_MS - ( l_this_tick - l_last_tick ) );
-    l_this_tick = l_last_tick + TRIX_FPS_MS;
+      /* Keep track of our performance metrics. */
+      metrics_update();
+    }
+    else if ( !sched_armed( TIMER_FRAME ) )
+    {
+      sched_at( TIMER_FRAME, SDL_GetTicks() + pace_wait() );
+    }
   }
 
-  /* Save the last frame tick. */
-  l_last_tick = l_this_tick;
-
   /* All done for this loop. */
   return;
 }
@@ -186,17 +225,23 @@ int main( int argc, char **argv )
   l_current_engine.render = splash_render;
   l_current_engine.fini = splash_fini;
 
-  /* Initialise the random number generator. It's not perfect, but it'll do. */
-  srand( time( NULL ) );
+  /* Precalculate the collision masks for all our pieces. */
+  piece_init();
 
   /* Set up the display. */
   if ( display_init() )
   {
-    /* Start up the text routines, used all over. */
+    /* Start up the asset cache, and the text routines used all over. */
+    asset_init();
     text_init();
 
+    /* And the frame pacer, to match however the display was set up. */
+    pace_init( config_get_int( CONF_VSYNC ) != 0 );
+
     /* Initialise the starting engine (display needs to be initialised first) */
+    sched_init();
     l_current_engine.init();
+    sched_at( TIMER_FRAME, SDL_GetTicks() );
 
     /* Dive into the main logic loop, until it exists. */
 #ifdef __EMSCRIPTEN__
@@ -208,8 +253,9 @@ int main( int argc, char **argv )
     }
 #endif
 
-    /* Shut down the text engine. */
+    /* Shut down the text engine, and let go of any assets still held. */
     text_fini();
+    asset_fini();
     
     /* Lastly, tear down the display. */
     display_fini();
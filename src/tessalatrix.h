@@ -15,6 +15,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include "SDL.h"
+#include "trixcore.h"
 
 
 /* Constants. */
@@ -26,19 +27,34 @@
 #endif /* PATH_MAX */
 
 #define   TRIX_FPS_MS                 16
-#define   TRIX_BOARD_HEIGHT           20
-#define   TRIX_BOARD_WIDTH            15
-
+#define   TRIX_FPS_RATE               60
+#define   TRIX_PACE_SPIN_US           2000
+#define   TRIX_CATCHUP_MS             1000
 #define   TRIX_MOVE_MS                75
-#define   TRIX_FALL_MS                25
-#define   TRIX_BASE_DROP_MS           250
+#define   TRIX_DAS_MS                 170
+#define   TRIX_ARR_MS                 50
+#define   TRIX_SCHED_IDLE_MS          1000
+#define   TRIX_INPUT_QUEUE_SIZE       256
+#define   TRIX_ATTRACT_MS             30000
+#define   TRIX_AI_ROLLOUT_HORIZON     6
+#define   TRIX_AI_ROLLOUT_BATCH       16
+#define   TRIX_AI_THINK_US            4000
+#define   TRIX_GHOST_ALPHA            80
 
 #define   TRIX_MENU_ENTRIES           5
 
 #define   TRIX_TEXT_FONT_START        32
 #define   TRIX_TEXT_FONT_LENGTH       95
+#define   TRIX_TEXT_RUN_MAX           64
+#define   TRIX_TEXT_CACHE_SIZE        32
 #define   TRIX_NAMELEN_MAX            32
 #define   TRIX_HISCORE_COUNT          10
+#define   TRIX_ASSET_CACHE_SIZE       16
+#define   TRIX_ASSET_NAME_MAX         32
+#define   TRIX_ASSET_WORKERS          2
+#define   TRIX_ASSET_INDEX_SIZE       64
+#define   TRIX_ASSET_FILE_MAX         96
+#define   TRIX_ASSET_ERROR_MAX        256
 
 
 /* Asset locations. */
@@ -67,26 +83,39 @@ typedef enum
 {
   CONF_LOG_LEVEL=1, CONF_LOG_FILENAME,
   CONF_RESOLUTION, CONF_PLAYERNAME,
+  CONF_SEED, CONF_AUTOPLAY, CONF_AI_PREVIEW, CONF_AI_ROLLOUTS,
+  CONF_DAS, CONF_ARR, CONF_VSYNC, CONF_ASSET_BUDGET,
   CONF_MAX
 } trix_config_t;
 
 typedef enum
 {
-  ENGINE_SPLASH, ENGINE_MENU, ENGINE_HSTABLE, ENGINE_GAME, ENGINE_OVER, ENGINE_EXIT
+  ENGINE_SPLASH, ENGINE_MENU, ENGINE_HSTABLE, ENGINE_GAME, ENGINE_OVER, ENGINE_AI,
+  ENGINE_EXIT
 } trix_engine_t;
 
 typedef enum
 {
-  GAME_MODE_STANDARD, GAME_MODE_MAX
-} trix_gamemode_t;
+  ALIGN_LEFT, ALIGN_RIGHT, ALIGN_CENTRE
+} trix_align_t;
+
+typedef enum
+{
+  ASSET_EMPTY, ASSET_QUEUED, ASSET_DECODING, ASSET_DECODED, ASSET_LOADED,
+  ASSET_FAILED
+} trix_asset_state_t;
+
+typedef enum
+{
+  QUEUED_KEY_DOWN, QUEUED_KEY_UP, QUEUED_MOTION, QUEUED_CLICK
+} trix_queued_t;
 
 typedef enum
 {
-  PIECE_NONE, 
-  PIECE_4_MIN, PIECE_4_SQUARE, PIECE_4_LONG, PIECE_4_ELL, 
-  PIECE_4_BELL, PIECE_4_TEE, PIECE_4_ESS, PIECE_4_BESS, PIECE_4_MAX,
-  PIECE_MAX
-} trix_piece_t;
+  TIMER_FRAME, TIMER_GRAVITY, TIMER_ANIMATION, TIMER_BLINK, TIMER_CURSOR, TIMER_IDLE,
+  TIMER_REPEAT,
+  TIMER_MAX
+} trix_timer_t;
 
 
 /* Structs. */
@@ -114,6 +143,49 @@ typedef struct {
   void          (*fini)(void);
 } trix_engine_st;
 
+typedef struct {
+  trix_queued_t type;
+  uint32_t      timestamp;
+  SDL_Keysym    key;
+  bool          repeat;
+  SDL_Point     point;
+} trix_queued_st;
+
+typedef struct {
+  char          text[TRIX_TEXT_RUN_MAX];
+  uint_fast8_t  length;
+  uint_fast8_t  scale;
+  SDL_Texture  *texture;
+  int           width;
+  uint_fast32_t last_used;
+} trix_text_run_st;
+
+typedef struct {
+  char          name[TRIX_ASSET_NAME_MAX];
+  uint_fast8_t  scale;
+  char          filename[TRIX_ASSET_FILE_MAX];
+} trix_asset_file_st;
+
+typedef struct {
+  char                name[TRIX_ASSET_NAME_MAX];
+  char                filename[TRIX_PATH_MAX+1];
+  uint_fast8_t        scale;
+  uint_fast8_t        asset_scale;
+  trix_asset_state_t  state;
+  char                error[TRIX_ASSET_ERROR_MAX];
+  SDL_Surface        *surface;
+  SDL_Texture        *texture;
+  uint_fast32_t       bytes;
+  uint_fast16_t       refcount;
+  uint_fast32_t       last_used;
+} trix_asset_st;
+
+typedef struct {
+  bool          held;
+  bool          charged;
+  uint_fast32_t next_tick;
+} trix_repeat_st;
+
 typedef struct {
   int_fast16_t  x;
   int_fast16_t  y;
@@ -122,13 +194,6 @@ typedef struct {
   uint_fast8_t  scale;
 } trix_resolution_st;
 
-typedef struct {
-  trix_piece_t  piece;
-  uint_fast8_t  value;
-  uint_fast8_t  block_count;
-  SDL_Point     blocks[4][5];
-} trix_piece_st;
-
 typedef struct {
   uint_fast16_t score;
   uint_fast16_t lines;
@@ -136,17 +201,22 @@ typedef struct {
   char          name[TRIX_NAMELEN_MAX+1];
 } trix_hiscore_st;
 
-typedef struct {
-  trix_gamemode_t mode;
-  uint_fast16_t   score;
-  uint_fast16_t   lines;
-  uint_fast8_t    board_width;
-  trix_piece_t    board[TRIX_BOARD_WIDTH][TRIX_BOARD_HEIGHT];
-} trix_gamestate_st;
-
 
 /* Prototypes. */
 
+void          ai_init( void );
+void          ai_event( const SDL_Event * );
+trix_engine_t ai_update( void );
+void          ai_render( void );
+void          ai_fini( void );
+
+void          asset_init( void );
+const char   *asset_locate( const char *, uint_fast8_t );
+void          asset_prefetch( const char * );
+SDL_Texture  *asset_acquire( const char *, uint_fast8_t * );
+void          asset_release( SDL_Texture * );
+void          asset_fini( void );
+
 bool          config_load( int, char ** );
 int32_t       config_get_int( trix_config_t );
 double        config_get_float( trix_config_t );
@@ -160,6 +230,7 @@ uint_fast8_t  display_get_scale( void );
 SDL_Point    *display_scale_point( uint_fast8_t, uint_fast8_t );
 SDL_Rect     *display_scale_rect_to_screen( uint_fast8_t, uint_fast8_t, uint_fast8_t, uint_fast8_t );
 SDL_Rect     *display_scale_rect_to_scale( uint_fast8_t, uint_fast8_t, uint_fast8_t, uint_fast8_t, uint_fast8_t );
+SDL_Texture  *display_create_layer( void );
 uint_fast8_t  display_find_asset( const char *, char * );
 
 void          game_init( void );
@@ -167,9 +238,17 @@ void          game_event( const SDL_Event * );
 trix_engine_t game_update( void );
 void          game_render( void );
 void          game_fini( void );
+void          game_restart( void );
+bool          game_step( trix_input_t );
+void          game_autoplay( bool );
+const trix_core_st      *game_core( void );
 const trix_gamestate_st *game_state( void );
 
 
+bool          input_push( const SDL_Event * );
+bool          input_pop( trix_queued_st * );
+void          input_flush( void );
+
 const trix_hiscore_st *hiscore_read( trix_gamemode_t );
 bool                   hiscore_save( trix_gamemode_t, uint_fast16_t, uint_fast16_t, const char * );
 
@@ -193,6 +272,7 @@ void          metrics_disable( void );
 void          metrics_toggle( void );
 void          metrics_update( void );
 void          metrics_render( void );
+void          metrics_missed( uint_fast32_t );
 
 void          over_init( void );
 void          over_event( const SDL_Event * );
@@ -200,7 +280,18 @@ trix_engine_t over_update( void );
 void          over_render( void );
 void          over_fini( void );
 
-const trix_piece_st *piece_select( trix_gamemode_t );
+void          pace_init( bool );
+void          pace_want( void );
+bool          pace_ready( void );
+uint_fast32_t pace_wait( void );
+void          pace_frame( void );
+
+void          sched_init( void );
+void          sched_at( trix_timer_t, uint_fast32_t );
+void          sched_cancel( trix_timer_t );
+bool          sched_armed( trix_timer_t );
+bool          sched_expire( uint_fast32_t );
+uint_fast32_t sched_wait( uint_fast32_t );
 
 void          splash_init( void );
 void          splash_event( const SDL_Event * );
@@ -212,7 +303,9 @@ void          text_init( void );
 void          text_draw( uint_fast8_t, uint_fast8_t, const char *, ... );
 void          text_draw_to( uint_fast8_t, uint_fast8_t, const char *, ... );
 void          text_draw_around( uint_fast8_t, uint_fast8_t, const char *, ... );
+void          text_draw_number( uint_fast8_t, uint_fast8_t, uint_fast32_t, uint_fast8_t );
 SDL_Rect      text_measure( const char *, ... );
+void          text_flush( void );
 void          text_fini( void );
 
 const char   *util_app_name( void );
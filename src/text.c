@@ -4,7 +4,9 @@
  * Deals with rendering text, from all different engines. Fonts are stored in
  * a dedicated spritesheet, with kernings defined here. This does make it all
  * a bit hand-coded but should mean we get the best results (and don't need to
- * pull in a heavyweight OTF-wrangling library).
+ * pull in a heavyweight OTF-wrangling library). Each run of text is drawn a
+ * letter at a time into a small texture of its own, the first time it's
+ * needed, and then copied in one go for as long as it's still in use.
  *
  * Copyright (c) 2023 Pete Favelle <ahnlak@ahnlak.com>
  *
@@ -16,7 +18,6 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include "SDL.h"
-#include "SDL_image.h"
 
 
 /* Local headers. */
@@ -38,6 +39,9 @@ static SDL_Rect       m_char_src_rect[TRIX_TEXT_FONT_LENGTH];
 static SDL_Texture   *m_sprite_texture;
 static uint_fast8_t   m_sprite_scale;
 
+static trix_text_run_st m_runs[TRIX_TEXT_CACHE_SIZE];
+static uint_fast32_t  m_run_clock;
+
 
 /*
  * Static functions; a collection of things only built for use locally.
@@ -53,15 +57,13 @@ static uint_fast8_t   m_sprite_scale;
 static bool text_load_sprites( void )
 {
   uint_fast8_t  l_index;
-  char          l_sprite_filename[TRIX_PATH_MAX+1];
   SDL_Rect     *l_src_rect;
 
   /* Load up the sprite image (hopefully!) */
-  m_sprite_scale = display_find_asset( TRIX_ASSET_TEXT_SPRITES, l_sprite_filename );
-  m_sprite_texture = IMG_LoadTexture( display_get_renderer(), l_sprite_filename );
+  asset_release( m_sprite_texture );
+  m_sprite_texture = asset_acquire( TRIX_ASSET_TEXT_SPRITES, &m_sprite_scale );
   if ( m_sprite_texture == NULL )
   {
-    log_write( ERROR, "IMG_LoadTexture of %s failed - %s", TRIX_ASSET_TEXT_SPRITES, SDL_GetError() );
     return false;
   }
 
@@ -80,6 +82,174 @@ static bool text_load_sprites( void )
 }
 
 
+/*
+ * draw_glyphs - draws a run of text a letter at a time, starting at the given
+ *               (physical) co-ordinates.
+ */
+
+static void text_draw_glyphs( const char *p_text, uint_fast8_t p_length,
+                              int p_x, int p_y )
+{
+  uint_fast8_t  l_index;
+  SDL_Rect      l_target_rect;
+
+  /* Every letter takes up the same block, however wide it really is. */
+  l_target_rect.x = p_x;
+  l_target_rect.y = p_y;
+  l_target_rect.w = l_target_rect.h = 5 * display_get_scale();
+
+  /* And work through the text blitting one letter at a time. */
+  for ( l_index = 0; l_index < p_length; l_index++ )
+  {
+    /* Write out the letter. */
+    SDL_RenderCopy( display_get_renderer(), m_sprite_texture,
+                    &m_char_src_rect[p_text[l_index]-TRIX_TEXT_FONT_START],
+                    &l_target_rect );
+
+    /* Move forward an appropriate amount - note we do no wrapping! */
+    l_target_rect.x += ( m_char_widths[p_text[l_index]-TRIX_TEXT_FONT_START] * display_get_scale() );
+  }
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * find_run - looks for an already rendered run of the given text, at the
+ *            current scale; if there isn't one, the least recently used run
+ *            is thrown away and the text rendered in its place. Returns NULL
+ *            if the run couldn't be rendered.
+ */
+
+static trix_text_run_st *text_find_run( const char *p_text, uint_fast8_t p_length,
+                                        int p_width )
+{
+  uint_fast8_t      l_index;
+  uint_fast8_t      l_scale = display_get_scale();
+  trix_text_run_st *l_run = &m_runs[0];
+  SDL_Texture      *l_target;
+  uint8_t           l_red, l_green, l_blue, l_alpha;
+
+  /* Look through what we have, keeping an eye out for the oldest. */
+  for ( l_index = 0; l_index < TRIX_TEXT_CACHE_SIZE; l_index++ )
+  {
+    if ( ( m_runs[l_index].texture != NULL ) && ( m_runs[l_index].scale == l_scale ) &&
+         ( m_runs[l_index].length == p_length ) &&
+         ( memcmp( m_runs[l_index].text, p_text, p_length ) == 0 ) )
+    {
+      m_runs[l_index].last_used = ++m_run_clock;
+      return &m_runs[l_index];
+    }
+    if ( m_runs[l_index].last_used < l_run->last_used )
+    {
+      l_run = &m_runs[l_index];
+    }
+  }
+
+  /* Not found, so make room and build a texture just big enough for it. */
+  if ( l_run->texture != NULL )
+  {
+    SDL_DestroyTexture( l_run->texture );
+  }
+  l_run->last_used = 0;
+  l_run->texture = SDL_CreateTexture( display_get_renderer(), SDL_PIXELFORMAT_RGBA8888,
+                                      SDL_TEXTUREACCESS_TARGET,
+                                      p_width * l_scale, 5 * l_scale );
+  if ( l_run->texture == NULL )
+  {
+    return NULL;
+  }
+  SDL_SetTextureBlendMode( l_run->texture, SDL_BLENDMODE_BLEND );
+
+  /* Draw the text into it, without upsetting whatever else is being drawn. */
+  l_target = SDL_GetRenderTarget( display_get_renderer() );
+  SDL_GetRenderDrawColor( display_get_renderer(), &l_red, &l_green, &l_blue, &l_alpha );
+  SDL_SetRenderTarget( display_get_renderer(), l_run->texture );
+  SDL_SetRenderDrawColor( display_get_renderer(), 0, 0, 0, 0 );
+  SDL_RenderClear( display_get_renderer() );
+  text_draw_glyphs( p_text, p_length, 0, 0 );
+  SDL_SetRenderTarget( display_get_renderer(), l_target );
+  SDL_SetRenderDrawColor( display_get_renderer(), l_red, l_green, l_blue, l_alpha );
+
+  /* And remember what it was. */
+  memcpy( l_run->text, p_text, p_length );
+  l_run->length = p_length;
+  l_run->scale = l_scale;
+  l_run->width = p_width * l_scale;
+  l_run->last_used = ++m_run_clock;
+  return l_run;
+}
+
+
+/*
+ * draw_run - draws a run of text, aligned on the given (logical) co-ordinates
+ *            in the same way as the public draw functions.
+ */
+
+static void text_draw_run( const char *p_text, int p_length, trix_align_t p_align,
+                           uint_fast8_t p_x, uint_fast8_t p_y )
+{
+  int               l_index;
+  int               l_width = 0, l_extent;
+  int               l_x = p_x, l_y = p_y;
+  trix_text_run_st *l_run;
+  SDL_Rect          l_target_rect;
+
+  /* Make sure we didn't overflow the buffer; there's no point in nothing. */
+  if ( p_length >= TRIX_TEXT_RUN_MAX )
+  {
+    p_length = TRIX_TEXT_RUN_MAX - 1;
+  }
+  if ( p_length <= 0 )
+  {
+    return;
+  }
+
+  /* Work out how wide the text is, and how far the last letter reaches. */
+  for ( l_index = 0; l_index < p_length; l_index++ )
+  {
+    l_width += m_char_widths[p_text[l_index]-TRIX_TEXT_FONT_START];
+  }
+  l_extent = l_width - m_char_widths[p_text[p_length-1]-TRIX_TEXT_FONT_START] + 5;
+
+  /* Now work out our starting point; right-aligned text has its last */
+  /* letter at the given point, centered text is centered vertically */
+  /* as well.                                                          */
+  switch( p_align )
+  {
+    case ALIGN_RIGHT:
+      l_x = p_x - l_width + m_char_widths[p_text[p_length-1]-TRIX_TEXT_FONT_START];
+      break;
+    case ALIGN_CENTRE:
+      l_x = p_x - ( l_width / 2 );
+      l_y = p_y - ( 5 / 2 );
+      break;
+    default:
+      break;
+  }
+
+  /* That may well be off the left of the screen, so scale it up from the */
+  /* origin rather than passing it through as a logical co-ordinate.      */
+  memcpy( &l_target_rect, display_scale_rect_to_screen( 0, 0, 5, 5 ), sizeof( SDL_Rect ) );
+  l_target_rect.x += l_x * display_get_scale();
+  l_target_rect.y += l_y * display_get_scale();
+
+  /* Copy the whole run in one go if we can, a letter at a time if not. */
+  l_run = text_find_run( p_text, p_length, l_extent );
+  if ( l_run == NULL )
+  {
+    text_draw_glyphs( p_text, p_length, l_target_rect.x, l_target_rect.y );
+    return;
+  }
+  l_target_rect.w = l_run->width;
+  SDL_RenderCopy( display_get_renderer(), l_run->texture, NULL, &l_target_rect );
+
+  /* All done. */
+  return;
+}
+
+
 /* Functions. */
 
 /*
@@ -95,6 +265,9 @@ void text_init( void )
     log_write( ERROR, "Failed to load text sprites" );
   }
 
+  /* Anything already rendered was rendered with the old sprites. */
+  text_flush();
+
   /* All done. */
   return;
 }
@@ -107,31 +280,17 @@ void text_init( void )
 
 void text_draw( uint_fast8_t p_x, uint_fast8_t p_y, const char *p_format, ... )
 {
-  uint_fast8_t  l_index;
   int           l_msglen;
-  char          l_buffer[64];
+  char          l_buffer[TRIX_TEXT_RUN_MAX];
   va_list       l_args;
-  SDL_Rect      l_target_rect;
 
   /* Attempt to assemble the message into our buffer. */
   va_start( l_args, p_format );
-  l_msglen = vsnprintf( l_buffer, 64, p_format, l_args );
+  l_msglen = vsnprintf( l_buffer, TRIX_TEXT_RUN_MAX, p_format, l_args );
   va_end( l_args );
 
-  /* Now work out our starting point in screen co-ordinates. */
-  memcpy( &l_target_rect, display_scale_rect_to_screen( p_x, p_y, 5, 5 ), sizeof( SDL_Rect ) );
-
-  /* And work through the buffer blitting one letter at a time. */
-  for ( l_index = 0; l_index < l_msglen; l_index++ )
-  {
-    /* Write out the letter. */
-    SDL_RenderCopy( display_get_renderer(), m_sprite_texture,
-                    &m_char_src_rect[l_buffer[l_index]-TRIX_TEXT_FONT_START],
-                    &l_target_rect );
-
-    /* Move forward an appropriate amount - note we do no wrapping! */
-    l_target_rect.x += ( m_char_widths[l_buffer[l_index]-TRIX_TEXT_FONT_START] * display_get_scale() );
-  }
+  /* And draw it. */
+  text_draw_run( l_buffer, l_msglen, ALIGN_LEFT, p_x, p_y );
 
   /* All done. */
   return;
@@ -146,31 +305,17 @@ void text_draw( uint_fast8_t p_x, uint_fast8_t p_y, const char *p_format, ... )
 
 void text_draw_to( uint_fast8_t p_x, uint_fast8_t p_y, const char *p_format, ... )
 {
-  uint_fast8_t  l_index;
   int           l_msglen;
-  char          l_buffer[64];
+  char          l_buffer[TRIX_TEXT_RUN_MAX];
   va_list       l_args;
-  SDL_Rect      l_target_rect;
 
   /* Attempt to assemble the message into our buffer. */
   va_start( l_args, p_format );
-  l_msglen = vsnprintf( l_buffer, 64, p_format, l_args );
+  l_msglen = vsnprintf( l_buffer, TRIX_TEXT_RUN_MAX, p_format, l_args );
   va_end( l_args );
 
-  /* Now work out our starting point in screen co-ordinates. */
-  memcpy( &l_target_rect, display_scale_rect_to_screen( p_x, p_y, 5, 5 ), sizeof( SDL_Rect ) );
-
-  /* And work backwards through the buffer blitting one letter at a time. */
-  for ( l_index = l_msglen; l_index > 0; l_index-- )
-  {
-    /* Write out the letter. */
-    SDL_RenderCopy( display_get_renderer(), m_sprite_texture,
-                    &m_char_src_rect[l_buffer[l_index-1]-TRIX_TEXT_FONT_START],
-                    &l_target_rect );
-
-    /* Move forward an appropriate amount - note we do no wrapping! */
-    l_target_rect.x -= ( m_char_widths[l_buffer[l_index-1]-TRIX_TEXT_FONT_START] * display_get_scale() );
-  }
+  /* And draw it. */
+  text_draw_run( l_buffer, l_msglen, ALIGN_RIGHT, p_x, p_y );
 
   /* All done. */
   return;
@@ -184,46 +329,45 @@ void text_draw_to( uint_fast8_t p_x, uint_fast8_t p_y, const char *p_format, ...
 
 void text_draw_around( uint_fast8_t p_x, uint_fast8_t p_y, const char *p_format, ... )
 {
-  uint_fast8_t  l_index;
   int           l_msglen;
-  char          l_buffer[64];
+  char          l_buffer[TRIX_TEXT_RUN_MAX];
   va_list       l_args;
-  SDL_Rect      l_target_rect;
-  SDL_Point     l_string_size;
 
   /* Attempt to assemble the message into our buffer. */
   va_start( l_args, p_format );
-  l_msglen = vsnprintf( l_buffer, 64, p_format, l_args );
+  l_msglen = vsnprintf( l_buffer, TRIX_TEXT_RUN_MAX, p_format, l_args );
   va_end( l_args );
 
-  /* First step then is to work out the size of our rendered string. */
-  l_string_size.y = 5;
-  l_string_size.x = 0;
-  for ( l_index = 0; l_index < l_msglen; l_index++ )
-  {
-    l_string_size.x += m_char_widths[l_buffer[l_index]-TRIX_TEXT_FONT_START];
-  }  
+  /* And draw it. */
+  text_draw_run( l_buffer, l_msglen, ALIGN_CENTRE, p_x, p_y );
+
+  /* All done. */
+  return;
+}
 
-  /* Now work out our starting point in screen co-ordinates. */
-  memcpy( &l_target_rect, 
-          display_scale_rect_to_screen( 
-            p_x - ( l_string_size.x / 2 ),
-            p_y - ( l_string_size.y / 2 ),
-            5, 5 
-          ), 
-          sizeof( SDL_Rect ) );
 
-  /* And work through the buffer blitting one letter at a time. */
-  for ( l_index = 0; l_index < l_msglen; l_index++ )
+/*
+ * draw_number - draws an unsigned number to the screen, starting at the
+ *               provided (logical, not physical) co-ordinates, and padded with
+ *               zeros to at least the given number of digits. This is for the
+ *               counters redrawn every frame, so skips the printf machinery.
+ */
+
+void text_draw_number( uint_fast8_t p_x, uint_fast8_t p_y, uint_fast32_t p_value,
+                       uint_fast8_t p_digits )
+{
+  char          l_buffer[TRIX_TEXT_RUN_MAX];
+  uint_fast8_t  l_start = TRIX_TEXT_RUN_MAX;
+
+  /* Work backwards from the last digit, padding as we go. */
+  do
   {
-    /* Write out the letter. */
-    SDL_RenderCopy( display_get_renderer(), m_sprite_texture,
-                    &m_char_src_rect[l_buffer[l_index]-TRIX_TEXT_FONT_START],
-                    &l_target_rect );
+    l_buffer[--l_start] = '0' + ( p_value % 10 );
+    p_value /= 10;
+  } while ( ( ( p_value > 0 ) || ( TRIX_TEXT_RUN_MAX - l_start < p_digits ) ) && ( l_start > 1 ) );
 
-    /* Move forward an appropriate amount - note we do no wrapping! */
-    l_target_rect.x += ( m_char_widths[l_buffer[l_index]-TRIX_TEXT_FONT_START] * display_get_scale() );
-  }
+  /* And draw it. */
+  text_draw_run( &l_buffer[l_start], TRIX_TEXT_RUN_MAX - l_start, ALIGN_LEFT, p_x, p_y );
 
   /* All done. */
   return;
@@ -261,6 +405,29 @@ SDL_Rect text_measure( const char *p_format, ... )
 }
 
 
+/*
+ * flush - throws away every rendered run; needed whenever they may no longer
+ *         be what we'd draw now, or if the renderer has lost their contents.
+ */
+
+void text_flush( void )
+{
+  uint_fast8_t  l_index;
+
+  for ( l_index = 0; l_index < TRIX_TEXT_CACHE_SIZE; l_index++ )
+  {
+    if ( m_runs[l_index].texture != NULL )
+    {
+      SDL_DestroyTexture( m_runs[l_index].texture );
+    }
+  }
+  memset( m_runs, 0, sizeof( m_runs ) );
+
+  /* All done. */
+  return;
+}
+
+
 /*
  * fini - release any allocated resources.
  */
@@ -268,9 +435,10 @@ SDL_Rect text_measure( const char *p_format, ... )
 void text_fini( void )
 {
   /* Release any loaded textures. */
+  text_flush();
   if ( m_sprite_texture != NULL )
   {
-    SDL_DestroyTexture( m_sprite_texture );
+    asset_release( m_sprite_texture );
     m_sprite_texture = NULL;
   }
 
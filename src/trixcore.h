@@ -0,0 +1,311 @@
+/*
+ * trixcore.h - part of Tessalatrix
+ *
+ * This is the header file for the Tessalatrix game core; the pure simulation
+ * of the game, with no dependency on SDL. It is used by the game itself, but
+ * can equally be linked into headless tools which have no display at all.
+ *
+ * Copyright (c) 2023 Pete Favelle <ahnlak@ahnlak.com>
+ *
+ * This file is released under the MIT License; see LICENSE for details.
+ */
+
+#ifndef   TRIX_TRIXCORE_H
+#define   TRIX_TRIXCORE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef    TRIX_CORE_THREADS
+#include <pthread.h>
+#include <stdatomic.h>
+#endif /* TRIX_CORE_THREADS */
+
+
+/* Constants. */
+
+#define   TRIX_BOARD_HEIGHT           20
+#define   TRIX_BOARD_WIDTH            15
+#define   TRIX_BOARD_ROW_MAX          16
+
+#define   TRIX_BASE_DROP_MS           250
+
+#define   TRIX_BATCH_LANES            16
+#define   TRIX_BATCH_HIDDEN           4
+#define   TRIX_BATCH_ROWS             (TRIX_BOARD_HEIGHT+TRIX_BATCH_HIDDEN)
+
+#define   TRIX_MOVES_MAX              128
+#define   TRIX_MOVES_PATH_MAX         64
+
+#define   TRIX_EVAL_TOPPED_OUT        -1000000.0
+
+#define   TRIX_SEARCH_DEPTH_MAX       4
+#define   TRIX_SEARCH_BEAM_WIDTH      32
+#define   TRIX_SEARCH_NODES_MAX       (TRIX_MOVES_MAX*(1+TRIX_SEARCH_DEPTH_MAX*TRIX_SEARCH_BEAM_WIDTH))
+#define   TRIX_SEARCH_TABLE_SIZE      8192
+
+#define   TRIX_ROLLOUT_CANDIDATES     8
+#define   TRIX_ROLLOUT_MAX            1024
+#define   TRIX_ROLLOUT_THREADS_MAX    64
+#define   TRIX_ROLLOUT_TABLE_SIZE     65536
+
+
+/* The board is held as one bitmask per row, so must fit into a row mask. */
+
+#if       TRIX_BOARD_WIDTH > TRIX_BOARD_ROW_MAX
+#error    "TRIX_BOARD_WIDTH must fit within a trix_row_t"
+#endif
+#if       TRIX_BOARD_HEIGHT > 32
+#error    "TRIX_BOARD_HEIGHT must fit within the cleared_rows mask"
+#endif
+#if       TRIX_BATCH_LANES > 32
+#error    "TRIX_BATCH_LANES must fit within the running lanes mask"
+#endif
+#if       TRIX_SEARCH_NODES_MAX >= 65535
+#error    "TRIX_SEARCH_NODES_MAX must fit within the search table entries"
+#endif
+#if       TRIX_SEARCH_TABLE_SIZE < 2*TRIX_SEARCH_BEAM_WIDTH*TRIX_MOVES_MAX
+#error    "TRIX_SEARCH_TABLE_SIZE must be at least twice the nodes in a ply"
+#endif
+#if       TRIX_SEARCH_TABLE_SIZE & (TRIX_SEARCH_TABLE_SIZE-1) || TRIX_ROLLOUT_TABLE_SIZE & (TRIX_ROLLOUT_TABLE_SIZE-1)
+#error    "TRIX_SEARCH_TABLE_SIZE and TRIX_ROLLOUT_TABLE_SIZE must be powers of two"
+#endif
+
+
+/* Enums. */
+
+typedef enum
+{
+  GAME_MODE_STANDARD, GAME_MODE_MAX
+} trix_gamemode_t;
+
+typedef enum
+{
+  PIECE_NONE,
+  PIECE_4_MIN, PIECE_4_SQUARE, PIECE_4_LONG, PIECE_4_ELL,
+  PIECE_4_BELL, PIECE_4_TEE, PIECE_4_ESS, PIECE_4_BESS, PIECE_4_MAX,
+  PIECE_MAX
+} trix_piece_t;
+
+typedef enum
+{
+  INPUT_NONE, INPUT_LEFT, INPUT_RIGHT, INPUT_ROTATE, INPUT_DROP,
+  INPUT_SHIFT_LEFT, INPUT_SHIFT_RIGHT, INPUT_MAX
+} trix_input_t;
+
+typedef enum
+{
+  ROLLOUT_RUNNING, ROLLOUT_WAITING, ROLLOUT_DONE
+} trix_rollout_poll_t;
+
+
+/* Types. */
+
+typedef uint16_t  trix_row_t;
+
+#ifdef    TRIX_CORE_THREADS
+typedef atomic_uint_fast64_t  trix_atomic_t;
+#else
+typedef uint_fast64_t         trix_atomic_t;
+#endif /* TRIX_CORE_THREADS */
+
+
+/* Structs. */
+
+typedef struct {
+  int_fast16_t  x;
+  int_fast16_t  y;
+} trix_point_st;
+
+typedef struct {
+  uint32_t      state[4];
+} trix_rng_st;
+
+typedef struct {
+  int_fast8_t   min_x;
+  int_fast8_t   max_x;
+  int_fast8_t   min_y;
+  int_fast8_t   max_y;
+  uint_fast8_t  height;
+  trix_row_t    rows[4];
+  int_fast8_t   bottom[4];
+} trix_piece_mask_st;
+
+typedef struct {
+  trix_piece_t        piece;
+  uint_fast8_t        value;
+  uint_fast8_t        block_count;
+  trix_point_st       blocks[4][5];
+  trix_piece_mask_st  masks[4];
+  uint_fast8_t        alias[4];
+} trix_piece_st;
+
+typedef struct {
+  trix_gamemode_t       mode;
+  uint_fast16_t         score;
+  uint_fast16_t         lines;
+  uint_fast32_t         pieces;
+  uint_fast8_t          board_width;
+  trix_row_t            full_row;
+  uint_fast32_t         cleared_rows;
+  trix_row_t            rows[TRIX_BOARD_HEIGHT];
+  uint8_t               cells[TRIX_BOARD_HEIGHT][TRIX_BOARD_WIDTH];
+  uint8_t               fill[TRIX_BOARD_HEIGHT];
+  uint8_t               surface[TRIX_BOARD_WIDTH];
+  uint_fast16_t         holes;
+  const trix_piece_st  *piece;
+  trix_point_st         location;
+  uint_fast8_t          rotation;
+  trix_point_st         landing;
+} trix_gamestate_st;
+
+typedef struct {
+  trix_gamestate_st     state;
+  uint_fast32_t         current_tick;
+  uint_fast32_t         last_drop_tick;
+  uint_fast32_t         drop_speed;
+  trix_rng_st           rng;
+} trix_core_st;
+
+typedef struct {
+  trix_row_t            board[TRIX_BATCH_ROWS][TRIX_BATCH_LANES];
+  trix_row_t            piece[TRIX_BATCH_ROWS][TRIX_BATCH_LANES];
+  trix_gamemode_t       mode;
+  uint_fast8_t          board_width;
+  trix_row_t            full_row;
+  const trix_piece_st  *current[TRIX_BATCH_LANES];
+  trix_point_st         location[TRIX_BATCH_LANES];
+  uint_fast8_t          rotation[TRIX_BATCH_LANES];
+  uint_fast16_t         score[TRIX_BATCH_LANES];
+  uint_fast16_t         lines[TRIX_BATCH_LANES];
+  bool                  over[TRIX_BATCH_LANES];
+  trix_rng_st           rng[TRIX_BATCH_LANES];
+} trix_batch_st;
+
+typedef struct {
+  double                height;
+  double                holes;
+  double                bumpiness;
+  double                wells;
+  double                lines;
+} trix_weights_st;
+
+typedef struct {
+  uint_fast8_t          rotation;
+  trix_point_st         location;
+  uint_fast8_t          path_length;
+  uint8_t               path[TRIX_MOVES_PATH_MAX];
+} trix_placement_st;
+
+typedef struct {
+  trix_row_t            rows[TRIX_BOARD_HEIGHT];
+  uint64_t              hash;
+  double                score;
+  uint16_t              lines;
+  uint16_t              first;
+} trix_search_node_st;
+
+typedef struct {
+  uint64_t              zobrist[TRIX_BOARD_HEIGHT][TRIX_BOARD_ROW_MAX];
+  trix_search_node_st   arena[TRIX_SEARCH_NODES_MAX];
+  uint_fast32_t         arena_used;
+  uint16_t              table[TRIX_SEARCH_TABLE_SIZE];
+  uint16_t              beam[TRIX_SEARCH_BEAM_WIDTH];
+  uint16_t              next[TRIX_SEARCH_BEAM_WIDTH];
+  uint_fast8_t          beam_size;
+  uint_fast8_t          next_size;
+  trix_placement_st     roots[TRIX_MOVES_MAX];
+  trix_core_st          scratch;
+} trix_search_st;
+
+typedef struct {
+  trix_atomic_t         next;
+  uint_fast32_t         end;
+  uint8_t               padding[48];
+} trix_rollout_queue_st;
+
+typedef struct {
+  trix_atomic_t         check;
+  trix_atomic_t         data;
+} trix_rollout_entry_st;
+
+typedef struct trix_rollout_st trix_rollout_st;
+
+typedef struct {
+  trix_rollout_st      *owner;
+  uint_fast8_t          index;
+#ifdef    TRIX_CORE_THREADS
+  pthread_t             thread;
+#endif /* TRIX_CORE_THREADS */
+} trix_rollout_worker_st;
+
+struct trix_rollout_st {
+  trix_core_st             root;
+  trix_weights_st          weights;
+  trix_placement_st        candidates[TRIX_ROLLOUT_CANDIDATES];
+  uint_fast8_t             candidate_count;
+  uint_fast16_t            rollouts;
+  uint_fast8_t             horizon;
+  uint64_t                 seed;
+  double                   results[TRIX_ROLLOUT_CANDIDATES*TRIX_ROLLOUT_MAX];
+  uint_fast8_t             threads;
+  trix_rollout_queue_st    queues[TRIX_ROLLOUT_THREADS_MAX];
+  trix_rollout_worker_st   workers[TRIX_ROLLOUT_THREADS_MAX];
+#ifdef    TRIX_CORE_THREADS
+  pthread_mutex_t          lock;
+  pthread_cond_t           wake;
+  pthread_cond_t           done;
+  uint_fast32_t            generation;
+  uint_fast8_t             busy;
+  bool                     stopping;
+#endif /* TRIX_CORE_THREADS */
+  trix_rollout_entry_st    table[TRIX_ROLLOUT_TABLE_SIZE];
+};
+
+
+/* Prototypes. */
+
+void          batch_init( trix_batch_st *, trix_gamemode_t, const uint64_t * );
+uint_fast32_t batch_step( trix_batch_st *, const trix_input_t * );
+void          batch_get_rows( const trix_batch_st *, uint_fast8_t, trix_row_t * );
+
+void          core_init( trix_core_st *, trix_gamemode_t, uint64_t );
+bool          core_step( trix_core_st *, trix_input_t, uint_fast32_t );
+bool          core_place( trix_core_st *, uint_fast8_t, trix_point_st );
+uint_fast32_t core_next_drop( const trix_core_st * );
+bool          core_check_space( const trix_core_st *, const trix_piece_st *, uint_fast8_t, trix_point_st );
+trix_point_st core_landing( const trix_core_st *, const trix_piece_st *, uint_fast8_t, trix_point_st );
+trix_point_st core_spawn_location( const trix_core_st * );
+uint_fast8_t  core_preview( const trix_core_st *, const trix_piece_st **, uint_fast8_t *, uint_fast8_t );
+const trix_gamestate_st *core_state( const trix_core_st * );
+
+void          eval_default_weights( trix_weights_st * );
+uint_fast8_t  eval_place( const trix_row_t *, trix_row_t, const trix_piece_st *, uint_fast8_t, trix_point_st, trix_row_t * );
+double        eval_board( const trix_row_t *, uint_fast8_t, uint_fast8_t, const trix_weights_st * );
+double        eval_state( const trix_gamestate_st *, uint_fast16_t, const trix_weights_st * );
+bool          eval_choose( const trix_core_st *, const trix_weights_st *, trix_placement_st * );
+
+uint_fast16_t moves_find( const trix_core_st *, trix_placement_st *, uint_fast16_t );
+trix_input_t  moves_next_input( const trix_core_st *, const trix_placement_st * );
+
+void                 piece_init( void );
+const trix_piece_st *piece_select( trix_gamemode_t, trix_rng_st * );
+
+bool          rollout_init( trix_rollout_st *, uint_fast8_t );
+void          rollout_fini( trix_rollout_st * );
+bool          rollout_start( trix_rollout_st *, const trix_core_st *, const trix_weights_st *, uint_fast16_t, uint_fast8_t );
+trix_rollout_poll_t rollout_poll( trix_rollout_st *, uint_fast32_t, trix_placement_st * );
+bool          rollout_choose( trix_rollout_st *, const trix_core_st *, const trix_weights_st *, uint_fast16_t, uint_fast8_t, trix_placement_st * );
+
+void          search_init( trix_search_st * );
+bool          search_choose( trix_search_st *, const trix_core_st *, const trix_weights_st *, uint_fast8_t, trix_placement_st * );
+
+void          rng_seed( trix_rng_st *, uint64_t );
+uint32_t      rng_next( trix_rng_st * );
+uint32_t      rng_range( trix_rng_st *, uint32_t );
+
+
+#endif /* TRIX_TRIXCORE_H */
+
+
+/* End of file trixcore.h */
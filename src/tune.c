@@ -0,0 +1,646 @@
+/*
+ * tune.c - part of Tessalatrix
+ *
+ * trix_tune; a headless tool for tuning the autoplayer's evaluation weights
+ * with a genetic algorithm. Every generation, each set of weights in the
+ * population plays the same seeded games (as fast as the core will go, spread
+ * across every core we have), and the weakest are replaced by offspring of
+ * the strongest. The population is checkpointed after every generation, so a
+ * long run can be stopped and picked up again later.
+ *
+ * Copyright (c) 2023 Pete Favelle <ahnlak@ahnlak.com>
+ *
+ * This file is released under the MIT License; see LICENSE for details.
+ */
+
+/* System headers. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef    TRIX_CORE_THREADS
+#include <unistd.h>
+#endif /* TRIX_CORE_THREADS */
+
+
+/* Local headers. */
+
+#include "trixcore.h"
+#include "version.h"
+
+
+/* Special wrangling to get optparse in the form we desire. */
+
+#define OPTPARSE_IMPLEMENTATION
+#define OPTPARSE_API static
+#include "optparse.h"
+
+
+/* Constants. */
+
+#define   TRIX_TUNE_GENES           5
+#define   TRIX_TUNE_POPULATION_MAX  256
+#define   TRIX_TUNE_GAMES_MAX       256
+#define   TRIX_TUNE_THREADS_MAX     256
+#define   TRIX_TUNE_FILENAME_MAX    256
+#define   TRIX_TUNE_CHECKPOINT      "trix_tune.ckpt"
+
+
+/* Structs. */
+
+typedef struct {
+  trix_weights_st weights;
+  double          fitness;
+} trix_tune_individual_st;
+
+
+/* Module variables. */
+
+static trix_tune_individual_st  m_population[TRIX_TUNE_POPULATION_MAX];
+static uint_fast16_t            m_population_size = 32;
+static uint_fast16_t            m_games = 16;
+static uint_fast32_t            m_max_pieces = 1000;
+static uint_fast32_t            m_generations = 100;
+static uint_fast32_t            m_generation;
+static uint_fast16_t            m_threads;
+static char                     m_checkpoint[TRIX_TUNE_FILENAME_MAX+1] = TRIX_TUNE_CHECKPOINT;
+static trix_rng_st              m_rng;
+
+static uint64_t                 m_game_seed;
+static trix_atomic_t            m_next_task;
+static uint_fast32_t            m_task_lines[TRIX_TUNE_POPULATION_MAX*TRIX_TUNE_GAMES_MAX];
+static uint_fast32_t            m_task_pieces[TRIX_TUNE_POPULATION_MAX*TRIX_TUNE_GAMES_MAX];
+
+
+/*
+ * Static functions; a collection of things only built for use locally.
+ */
+
+/*
+ * get_genes / set_genes - converts between a set of weights and a simple
+ *                         array of genes, for the benefit of breeding.
+ */
+
+static void tune_get_genes( const trix_weights_st *p_weights, double *p_genes )
+{
+  p_genes[0] = p_weights->height;
+  p_genes[1] = p_weights->holes;
+  p_genes[2] = p_weights->bumpiness;
+  p_genes[3] = p_weights->wells;
+  p_genes[4] = p_weights->lines;
+  return;
+}
+static void tune_set_genes( trix_weights_st *p_weights, double *p_genes )
+{
+  uint_fast8_t  l_index;
+  double        l_length = 0.0;
+
+  /* Weights only matter relative to each other, so scale them such that */
+  /* their sizes add up to one.                                          */
+  for ( l_index = 0; l_index < TRIX_TUNE_GENES; l_index++ )
+  {
+    l_length += p_genes[l_index] < 0.0 ? -p_genes[l_index] : p_genes[l_index];
+  }
+  l_length = l_length > 0.0 ? l_length : 1.0;
+
+  p_weights->height = p_genes[0] / l_length;
+  p_weights->holes = p_genes[1] / l_length;
+  p_weights->bumpiness = p_genes[2] / l_length;
+  p_weights->wells = p_genes[3] / l_length;
+  p_weights->lines = p_genes[4] / l_length;
+  return;
+}
+
+
+/*
+ * random - returns a random double, from 0 up to (but not including) 1.
+ */
+
+static double tune_random( void )
+{
+  return rng_next( &m_rng ) / 4294967296.0;
+}
+
+
+/*
+ * seconds - returns a wall clock time in seconds, for throughput stats.
+ */
+
+static double tune_seconds( void )
+{
+  struct timespec l_now;
+
+  timespec_get( &l_now, TIME_UTC );
+  return l_now.tv_sec + l_now.tv_nsec / 1e9;
+}
+
+
+/*
+ * play - plays a single headless game, for one individual with one of this
+ *        generation's seeds. Pieces are placed where the weights say is best,
+ *        straight away, until the game ends or reaches the piece limit.
+ */
+
+static void tune_play( uint_fast32_t p_task )
+{
+  const trix_weights_st  *l_weights = &m_population[p_task / m_games].weights;
+  trix_core_st            l_core;
+  trix_placement_st       l_choice;
+
+  /* Start the game, with the first piece. */
+  core_init( &l_core, GAME_MODE_STANDARD, m_game_seed + p_task % m_games );
+  if ( core_step( &l_core, INPUT_NONE, 0 ) )
+  {
+    /* Then play it out. */
+    while ( l_core.state.pieces < m_max_pieces )
+    {
+      if ( ( !eval_choose( &l_core, l_weights, &l_choice ) ) ||
+           ( !core_place( &l_core, l_choice.rotation, l_choice.location ) ) )
+      {
+        break;
+      }
+    }
+  }
+
+  /* And record how it went. */
+  m_task_lines[p_task] = l_core.state.lines;
+  m_task_pieces[p_task] = l_core.state.pieces;
+  return;
+}
+
+
+/*
+ * work - plays games until there are none left; each one is claimed with an
+ *        atomic increment, so whichever thread is free takes the next.
+ */
+
+static void *tune_work( void *p_arg )
+{
+  uint_fast32_t l_task;
+  uint_fast32_t l_tasks = m_population_size * m_games;
+
+#ifdef    TRIX_CORE_THREADS
+  while ( ( l_task = atomic_fetch_add( &m_next_task, 1 ) ) < l_tasks )
+#else
+  while ( ( l_task = m_next_task++ ) < l_tasks )
+#endif /* TRIX_CORE_THREADS */
+  {
+    tune_play( l_task );
+  }
+
+  return NULL;
+}
+
+
+/*
+ * evaluate - plays every individual through this generation's games, across
+ *            all our threads, and works out their fitness; the average number
+ *            of lines cleared. Returns the number of pieces played in all.
+ */
+
+static uint_fast64_t tune_evaluate( void )
+{
+  uint_fast16_t l_individual, l_game;
+  uint_fast64_t l_pieces = 0;
+#ifdef    TRIX_CORE_THREADS
+  pthread_t     l_workers[TRIX_TUNE_THREADS_MAX];
+  uint_fast16_t l_thread, l_started;
+#endif /* TRIX_CORE_THREADS */
+
+  /* Every generation plays a fresh set of games, so nobody overfits. */
+  m_game_seed = ( (uint64_t)rng_next( &m_rng ) << 32 ) | rng_next( &m_rng );
+  m_next_task = 0;
+
+#ifdef    TRIX_CORE_THREADS
+  /* Start up the workers, and do our own share alongside them. */
+  for ( l_started = 0, l_thread = 1; l_thread < m_threads; l_thread++ )
+  {
+    if ( pthread_create( &l_workers[l_started], NULL, tune_work, NULL ) == 0 )
+    {
+      l_started++;
+    }
+  }
+  tune_work( NULL );
+  for ( l_thread = 0; l_thread < l_started; l_thread++ )
+  {
+    pthread_join( l_workers[l_thread], NULL );
+  }
+#else
+  tune_work( NULL );
+#endif /* TRIX_CORE_THREADS */
+
+  /* Total up the results. */
+  for ( l_individual = 0; l_individual < m_population_size; l_individual++ )
+  {
+    m_population[l_individual].fitness = 0.0;
+    for ( l_game = 0; l_game < m_games; l_game++ )
+    {
+      m_population[l_individual].fitness += m_task_lines[l_individual * m_games + l_game];
+      l_pieces += m_task_pieces[l_individual * m_games + l_game];
+    }
+    m_population[l_individual].fitness /= m_games;
+  }
+
+  return l_pieces;
+}
+
+
+/*
+ * sort - orders the population, fittest first; a simple insertion sort is
+ *        plenty for populations this size.
+ */
+
+static void tune_sort( void )
+{
+  trix_tune_individual_st l_individual;
+  uint_fast16_t           l_index, l_slot;
+
+  for ( l_index = 1; l_index < m_population_size; l_index++ )
+  {
+    l_individual = m_population[l_index];
+    for ( l_slot = l_index;
+          ( l_slot > 0 ) && ( m_population[l_slot-1].fitness < l_individual.fitness );
+          l_slot-- )
+    {
+      m_population[l_slot] = m_population[l_slot-1];
+    }
+    m_population[l_slot] = l_individual;
+  }
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * tournament - picks a parent; the fittest of a random tenth of the
+ *              population. The population is sorted, so that's simply the
+ *              lowest index drawn.
+ */
+
+static uint_fast16_t tune_tournament( void )
+{
+  uint_fast16_t l_draw, l_pick, l_best = m_population_size;
+  uint_fast16_t l_size = m_population_size / 10 > 2 ? m_population_size / 10 : 2;
+
+  for ( l_draw = 0; l_draw < l_size; l_draw++ )
+  {
+    l_pick = rng_range( &m_rng, m_population_size );
+    if ( l_pick < l_best )
+    {
+      l_best = l_pick;
+    }
+  }
+
+  return l_best;
+}
+
+
+/*
+ * breed - replaces the weakest 30% of the (sorted) population with offspring
+ *         of tournament winners; each child is the parents' genes averaged,
+ *         weighted by fitness, with the occasional small mutation.
+ */
+
+static void tune_breed( void )
+{
+  double        l_genes[TRIX_TUNE_GENES], l_mother[TRIX_TUNE_GENES], l_father[TRIX_TUNE_GENES];
+  double        l_mother_fit, l_father_fit;
+  uint_fast16_t l_child, l_mother_index, l_father_index;
+  uint_fast8_t  l_gene;
+
+  for ( l_child = m_population_size - ( m_population_size * 3 ) / 10;
+        l_child < m_population_size; l_child++ )
+  {
+    /* Pick the parents. */
+    l_mother_index = tune_tournament();
+    l_father_index = tune_tournament();
+    tune_get_genes( &m_population[l_mother_index].weights, l_mother );
+    tune_get_genes( &m_population[l_father_index].weights, l_father );
+    l_mother_fit = m_population[l_mother_index].fitness;
+    l_father_fit = m_population[l_father_index].fitness;
+    if ( l_mother_fit + l_father_fit <= 0.0 )
+    {
+      l_mother_fit = l_father_fit = 1.0;
+    }
+
+    /* Blend them, and maybe mutate a gene. */
+    for ( l_gene = 0; l_gene < TRIX_TUNE_GENES; l_gene++ )
+    {
+      l_genes[l_gene] = ( l_mother[l_gene] * l_mother_fit + l_father[l_gene] * l_father_fit ) /
+                        ( l_mother_fit + l_father_fit );
+    }
+    if ( tune_random() < 0.05 )
+    {
+      l_genes[rng_range( &m_rng, TRIX_TUNE_GENES )] += tune_random() * 0.4 - 0.2;
+    }
+
+    /* And the child takes the place of one of the weakest. */
+    tune_set_genes( &m_population[l_child].weights, l_genes );
+    m_population[l_child].fitness = 0.0;
+  }
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * save_checkpoint - writes out everything needed to carry on from the next
+ *                   generation; to a temporary file first, then renamed into
+ *                   place, so a badly timed interrupt can't lose the lot.
+ */
+
+static bool tune_save_checkpoint( void )
+{
+  char            l_filename[TRIX_TUNE_FILENAME_MAX+8];
+  double          l_genes[TRIX_TUNE_GENES];
+  uint_fast16_t   l_index;
+  FILE           *l_fileptr;
+
+  snprintf( l_filename, sizeof( l_filename ), "%s.tmp", m_checkpoint );
+  l_fileptr = fopen( l_filename, "w" );
+  if ( l_fileptr == NULL )
+  {
+    return false;
+  }
+
+  fprintf( l_fileptr, "trix_tune 1\n%u %u %u %u %u %u\n",
+           (unsigned int)m_generation, (unsigned int)m_population_size,
+           (unsigned int)m_rng.state[0], (unsigned int)m_rng.state[1],
+           (unsigned int)m_rng.state[2], (unsigned int)m_rng.state[3] );
+  for ( l_index = 0; l_index < m_population_size; l_index++ )
+  {
+    tune_get_genes( &m_population[l_index].weights, l_genes );
+    fprintf( l_fileptr, "%.17g %.17g %.17g %.17g %.17g %.17g\n",
+             l_genes[0], l_genes[1], l_genes[2], l_genes[3], l_genes[4],
+             m_population[l_index].fitness );
+  }
+
+  /* All done! */
+  fclose( l_fileptr );
+#ifdef    _WIN32
+  /* Only Windows refuses to rename over an existing file. */
+  remove( m_checkpoint );
+#endif /* _WIN32 */
+  return rename( l_filename, m_checkpoint ) == 0;
+}
+
+
+/*
+ * load_checkpoint - picks up where a previous run left off, if there's a
+ *                   checkpoint to be found. Returns false if there isn't one
+ *                   (or it can't be understood), leaving things untouched.
+ */
+
+static bool tune_load_checkpoint( void )
+{
+  trix_tune_individual_st l_population[TRIX_TUNE_POPULATION_MAX];
+  double                  l_genes[TRIX_TUNE_GENES];
+  unsigned int            l_header[6], l_version;
+  uint_fast16_t           l_index;
+  FILE                   *l_fileptr;
+
+  l_fileptr = fopen( m_checkpoint, "r" );
+  if ( l_fileptr == NULL )
+  {
+    return false;
+  }
+
+  /* Check the header makes sense. */
+  if ( ( fscanf( l_fileptr, "trix_tune %u", &l_version ) != 1 ) || ( l_version != 1 ) ||
+       ( fscanf( l_fileptr, "%u %u %u %u %u %u", &l_header[0], &l_header[1], &l_header[2],
+                 &l_header[3], &l_header[4], &l_header[5] ) != 6 ) ||
+       ( l_header[1] < 2 ) || ( l_header[1] > TRIX_TUNE_POPULATION_MAX ) )
+  {
+    fclose( l_fileptr );
+    return false;
+  }
+
+  /* And then read in the whole population. */
+  for ( l_index = 0; l_index < l_header[1]; l_index++ )
+  {
+    if ( fscanf( l_fileptr, "%lf %lf %lf %lf %lf %lf", &l_genes[0], &l_genes[1], &l_genes[2],
+                 &l_genes[3], &l_genes[4], &l_population[l_index].fitness ) != 6 )
+    {
+      fclose( l_fileptr );
+      return false;
+    }
+    tune_set_genes( &l_population[l_index].weights, l_genes );
+  }
+  fclose( l_fileptr );
+
+  /* Good; all of it was valid, so it's safe to take it on. */
+  m_generation = l_header[0];
+  m_population_size = l_header[1];
+  for ( l_index = 0; l_index < 4; l_index++ )
+  {
+    m_rng.state[l_index] = l_header[2+l_index];
+  }
+  memcpy( m_population, l_population, sizeof( trix_tune_individual_st ) * m_population_size );
+  return true;
+}
+
+
+/*
+ * populate - creates a fresh, random population; the hand-picked defaults
+ *            are included, so we never start off worse than them.
+ */
+
+static void tune_populate( void )
+{
+  double        l_genes[TRIX_TUNE_GENES];
+  uint_fast16_t l_index;
+  uint_fast8_t  l_gene;
+
+  eval_default_weights( &m_population[0].weights );
+  tune_get_genes( &m_population[0].weights, l_genes );
+  tune_set_genes( &m_population[0].weights, l_genes );
+  for ( l_index = 1; l_index < m_population_size; l_index++ )
+  {
+    for ( l_gene = 0; l_gene < TRIX_TUNE_GENES; l_gene++ )
+    {
+      l_genes[l_gene] = tune_random() * 2.0 - 1.0;
+    }
+    tune_set_genes( &m_population[l_index].weights, l_genes );
+  }
+  m_generation = 0;
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * parse_options - works through the command line; returns false if we should
+ *                 exit straight away.
+ */
+
+static bool tune_parse_options( char **p_argv )
+{
+  int     l_opt_active;
+  struct  optparse      l_opt_struct;
+  struct  optparse_long l_opt_opts[] = {
+    {"help",        'h', OPTPARSE_NONE},
+    {"generations", 'g', OPTPARSE_REQUIRED},
+    {"population",  'p', OPTPARSE_REQUIRED},
+    {"games",       'n', OPTPARSE_REQUIRED},
+    {"pieces",      'm', OPTPARSE_REQUIRED},
+    {"threads",     't', OPTPARSE_REQUIRED},
+    {"checkpoint",  'c', OPTPARSE_REQUIRED},
+    {"seed",        's', OPTPARSE_REQUIRED},
+    {0}
+  };
+
+  optparse_init( &l_opt_struct, p_argv );
+  while( ( l_opt_active = optparse_long( &l_opt_struct, l_opt_opts, NULL ) ) != -1 )
+  {
+    switch( l_opt_active )
+    {
+      case 'g':
+        m_generations = strtoul( l_opt_struct.optarg, NULL, 10 );
+        break;
+      case 'p':
+        m_population_size = atoi( l_opt_struct.optarg );
+        if ( ( m_population_size < 2 ) || ( m_population_size > TRIX_TUNE_POPULATION_MAX ) )
+        {
+          printf( "Population must be between 2 and %d\n", TRIX_TUNE_POPULATION_MAX );
+          return false;
+        }
+        break;
+      case 'n':
+        m_games = atoi( l_opt_struct.optarg );
+        if ( ( m_games < 1 ) || ( m_games > TRIX_TUNE_GAMES_MAX ) )
+        {
+          printf( "Games must be between 1 and %d\n", TRIX_TUNE_GAMES_MAX );
+          return false;
+        }
+        break;
+      case 'm':
+        m_max_pieces = strtoul( l_opt_struct.optarg, NULL, 10 );
+        break;
+      case 't':
+        m_threads = atoi( l_opt_struct.optarg );
+        break;
+      case 'c':
+        strncpy( m_checkpoint, l_opt_struct.optarg, TRIX_TUNE_FILENAME_MAX );
+        m_checkpoint[TRIX_TUNE_FILENAME_MAX] = '\0';
+        break;
+      case 's':
+        rng_seed( &m_rng, strtoull( l_opt_struct.optarg, NULL, 10 ) );
+        break;
+      case '?':
+        printf( "trix_tune error: %s\n", l_opt_struct.errmsg );
+        return false;
+      case 'h':
+      default:
+        printf( "trix_tune, for %s V%d.%d.%03d\n", TRIX_PROJECT_NAME,
+                TRIX_VERSION_MAJOR, TRIX_VERSION_MINOR, TRIX_VERSION_PATCH );
+        printf( "\nUsage: %s [OPTIONS]\nwhere [OPTIONS] is one or more of:\n\n", p_argv[0] );
+        printf( "-h, --help           display this help text, and exit\n" );
+        printf( "-g, --generations=N  stops after generation N (default 100)\n" );
+        printf( "-p, --population=N   sets of weights in the population (default 32)\n" );
+        printf( "-n, --games=N        games each set of weights plays per generation (default 16)\n" );
+        printf( "-m, --pieces=N       longest any one game can run, in pieces (default 1000)\n" );
+        printf( "-t, --threads=N      threads to play games on (default one per processor)\n" );
+        printf( "-c, --checkpoint=F   checkpoint file, resumed from if it exists (default %s)\n", TRIX_TUNE_CHECKPOINT );
+        printf( "-s, --seed=N         seeds a fresh run, for repeatability\n\n" );
+        return false;
+    }
+  }
+
+  return true;
+}
+
+
+/* Functions. */
+
+/*
+ * main - the standard entry to the program.
+ */
+
+int main( int argc, char **argv )
+{
+  double          l_genes[TRIX_TUNE_GENES];
+  double          l_start, l_elapsed, l_mean;
+  uint_fast64_t   l_pieces;
+  uint_fast16_t   l_index;
+#ifdef    TRIX_CORE_THREADS
+  long            l_processors;
+#endif /* TRIX_CORE_THREADS */
+
+  /* Sort out our options; by default, a different run every time. */
+  rng_seed( &m_rng, (uint64_t)time( NULL ) );
+#ifdef    TRIX_CORE_THREADS
+  /* If we can't tell how many processors there are, assume just the one. */
+  l_processors = sysconf( _SC_NPROCESSORS_ONLN );
+  m_threads = l_processors < 1 ? 1 :
+              l_processors > TRIX_TUNE_THREADS_MAX ? TRIX_TUNE_THREADS_MAX : l_processors;
+#else
+  m_threads = 1;
+#endif /* TRIX_CORE_THREADS */
+  if ( !tune_parse_options( argv ) )
+  {
+    return 0;
+  }
+  if ( ( m_threads < 1 ) || ( m_threads > TRIX_TUNE_THREADS_MAX ) )
+  {
+    m_threads = m_threads < 1 ? 1 : TRIX_TUNE_THREADS_MAX;
+  }
+
+  /* The core needs its piece masks. */
+  piece_init();
+
+  /* Carry on from a checkpoint if we have one, or start afresh. */
+  if ( tune_load_checkpoint() )
+  {
+    printf( "Resuming from %s at generation %u\n", m_checkpoint, (unsigned int)m_generation );
+  }
+  else
+  {
+    tune_populate();
+  }
+  printf( "Population %u, %u games of up to %u pieces each, on %u threads\n",
+          (unsigned int)m_population_size, (unsigned int)m_games,
+          (unsigned int)m_max_pieces, (unsigned int)m_threads );
+
+  /* And run through the generations. */
+  while ( m_generation < m_generations )
+  {
+    /* Play all the games, and rank everyone. */
+    l_start = tune_seconds();
+    l_pieces = tune_evaluate();
+    l_elapsed = tune_seconds() - l_start;
+    tune_sort();
+
+    /* Report on how it went. */
+    for ( l_mean = 0.0, l_index = 0; l_index < m_population_size; l_index++ )
+    {
+      l_mean += m_population[l_index].fitness;
+    }
+    l_mean /= m_population_size;
+    tune_get_genes( &m_population[0].weights, l_genes );
+    printf( "Generation %u: best %.1f lines, mean %.1f; %.1f games/sec, %.0f pieces/sec\n",
+            (unsigned int)m_generation, m_population[0].fitness, l_mean,
+            m_population_size * m_games / l_elapsed, l_pieces / l_elapsed );
+    printf( "  height %.6f holes %.6f bumpiness %.6f wells %.6f lines %.6f\n",
+            l_genes[0], l_genes[1], l_genes[2], l_genes[3], l_genes[4] );
+    fflush( stdout );
+
+    /* Breed the next generation, and save it in case we're stopped. */
+    tune_breed();
+    m_generation++;
+    if ( !tune_save_checkpoint() )
+    {
+      fprintf( stderr, "Failed to write checkpoint to %s\n", m_checkpoint );
+    }
+  }
+
+  /* All done, return success to the commandline. */
+  return 0;
+}
+
+
+/* End of file tune.c */